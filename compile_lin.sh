@@ -6,7 +6,7 @@ CFLAGS="-Wno-implicit-function-declaration \
        -I${OSDEP_DIR} \
        -Iinclude \
        "
-LDFLAGS="-L./ -larvid_client -lz -lpthread"
+LDFLAGS="-L./ -larvid_client -lz -lpthread -lrt"
 
 rm libarvid_client.*
 rm -rf ${OUT_DIR}
@@ -15,11 +15,17 @@ mkdir -p ${OUT_DIR}
 # compile arvid-client library
 gcc -c ${CFLAGS} ${OSDEP_DIR}/tsync.c -o ${OUT_DIR}/tsync.o
 gcc -c ${CFLAGS} ${SRC_DIR}/crc.c -o ${OUT_DIR}/crc.o
+gcc -c ${CFLAGS} -O2 ${SRC_DIR}/trace.c -o ${OUT_DIR}/trace.o
+gcc -c ${CFLAGS} -O2 ${SRC_DIR}/pixconv.c -o ${OUT_DIR}/pixconv.o
 gcc -c ${CFLAGS} -O2 ${SRC_DIR}/arvid_client.c -o ${OUT_DIR}/arvid_client.o
-ar rcs libarvid_client.a ${OUT_DIR}/tsync.o ${OUT_DIR}/crc.o ${OUT_DIR}/arvid_client.o 
+ar rcs libarvid_client.a ${OUT_DIR}/tsync.o ${OUT_DIR}/crc.o ${OUT_DIR}/trace.o ${OUT_DIR}/pixconv.o ${OUT_DIR}/arvid_client.o 
 
 # compile tools
 gcc ${CFLAGS} -o ${OUT_DIR}/demo ${SRC_DIR}/demo.c ${LDFLAGS}
 #gcc ${CFLAGS} -o ${OUT_DIR}/sync ${SRC_DIR}/sync.c ${LDFLAGS}
 gcc ${CFLAGS} -o ${OUT_DIR}/fw_upload ${SRC_DIR}/fw_upload.c ${LDFLAGS}
 gcc ${CFLAGS} -o ${OUT_DIR}/arvid_poweroff ${SRC_DIR}/arvid_poweroff.c ${LDFLAGS}
+gcc ${CFLAGS} -O2 -o ${OUT_DIR}/arvid_emu ${SRC_DIR}/arvid_emu.c ${LDFLAGS}
+gcc ${CFLAGS} -O2 -o ${OUT_DIR}/bench ${SRC_DIR}/bench.c ${LDFLAGS}
+gcc ${CFLAGS} -O2 -o ${OUT_DIR}/replay ${SRC_DIR}/replay.c ${LDFLAGS}
+gcc ${CFLAGS} -O2 -o ${OUT_DIR}/arvid_stat ${SRC_DIR}/arvid_stat.c ${LDFLAGS}
@@ -16,8 +16,10 @@ mkdir -p ${OUT_DIR}
 # compile arvid-client library
 gcc -c ${CFLAGS} ${OSDEP_DIR}/tsync.c -o ${OUT_DIR}/tsync.o
 gcc -c ${CFLAGS} ${SRC_DIR}/crc.c -o ${OUT_DIR}/crc.o
+gcc -c ${CFLAGS} -O2 ${SRC_DIR}/trace.c -o ${OUT_DIR}/trace.o
+gcc -c ${CFLAGS} -O2 ${SRC_DIR}/pixconv.c -o ${OUT_DIR}/pixconv.o
 gcc -c ${CFLAGS} -O2 ${SRC_DIR}/arvid_client.c -o ${OUT_DIR}/arvid_client.o
-ar rcs libarvid_client.a ${OUT_DIR}/tsync.o ${OUT_DIR}/crc.o ${OUT_DIR}/arvid_client.o 
+ar rcs libarvid_client.a ${OUT_DIR}/tsync.o ${OUT_DIR}/crc.o ${OUT_DIR}/trace.o ${OUT_DIR}/pixconv.o ${OUT_DIR}/arvid_client.o 
 
 # compile tools
 gcc ${CFLAGS} -o ${OUT_DIR}/demo ${SRC_DIR}/demo.c ${LDFLAGS}
@@ -22,8 +22,10 @@ mkdir -p ${OUT_DIR}
 # compile arvid-client library
 ${PREFIX}gcc -c ${CFLAGS} ${OSDEP_DIR}/tsync.c -o ${OUT_DIR}/tsync.o
 ${PREFIX}gcc -c ${CFLAGS} ${SRC_DIR}/crc.c -o ${OUT_DIR}/crc.o
+${PREFIX}gcc -c ${CFLAGS} ${SRC_DIR}/trace.c -o ${OUT_DIR}/trace.o
+${PREFIX}gcc -c ${CFLAGS} ${SRC_DIR}/pixconv.c -o ${OUT_DIR}/pixconv.o
 ${PREFIX}gcc -c ${CFLAGS} -O2 ${SRC_DIR}/arvid_client.c -o ${OUT_DIR}/arvid_client.o
-${PREFIX}ar rcs libarvid_client.a ${OUT_DIR}/tsync.o ${OUT_DIR}/crc.o ${OUT_DIR}/arvid_client.o
+${PREFIX}ar rcs libarvid_client.a ${OUT_DIR}/tsync.o ${OUT_DIR}/crc.o ${OUT_DIR}/trace.o ${OUT_DIR}/pixconv.o ${OUT_DIR}/arvid_client.o
 
 # compile tools
 ${PREFIX}gcc ${CFLAGS} -o ${OUT_DIR}/demo.exe ${SRC_DIR}/demo.c ${LDFLAGS}
@@ -42,9 +42,49 @@ IN THE PRODUCT.
 #define ARVID_512 11
 #define ARVID_640 12
 
+/* vsync wait modes */
+#define ARVID_VSYNC_SERVER 0
+#define ARVID_VSYNC_LOCAL 1
+#define ARVID_VSYNC_PUSH 2
+
+/* error codes */
+#define ARVID_CLIENT_ERROR_TIMEOUT (-110)
+
 #define ARVID_BLIT_TYPE_BLOCKING 0
 #define ARVID_BLIT_TYPE_NON_BLOCKING 1
 
+/* pixel formats of the blitted buffer */
+#define ARVID_FORMAT_RGB555 0		/* native: 0RRRRRGGGGGBBBBB */
+#define ARVID_FORMAT_RGB565 1		/* RRRRRGGGGGGBBBBB */
+#define ARVID_FORMAT_BGR565 2		/* BBBBBGGGGGGRRRRR */
+#define ARVID_FORMAT_XRGB8888 3		/* 32 bit 0xXXRRGGBB */
+#define ARVID_FORMAT_XBGR8888 4		/* 32 bit 0xXXBBGGRR */
+
+/* dither modes of the 32 bit pixel formats */
+#define ARVID_DITHER_NONE 0
+#define ARVID_DITHER_STABLE 1
+#define ARVID_DITHER_TEMPORAL 2
+
+/* scaling filters */
+#define ARVID_SCALE_NEAREST 0
+#define ARVID_SCALE_INTEGER 1
+#define ARVID_SCALE_BILINEAR 2
+
+/* rotations (clockwise) and flips of the blitted frames */
+#define ARVID_ROTATE_0 0
+#define ARVID_ROTATE_90 1
+#define ARVID_ROTATE_180 2
+#define ARVID_ROTATE_270 3
+#define ARVID_FLIP_H (1 << 2)		/* mirror left to right */
+#define ARVID_FLIP_V (1 << 3)		/* mirror top to bottom */
+
+/* entries of the color table: one per RGB555 color */
+#define ARVID_LUT_SIZE (1 << 15)
+
+/* send flags */
+#define ARVID_SEND_BATCH (1 << 0)
+#define ARVID_SEND_ZEROCOPY (1 << 1)
+
 #define ARVID_TATE_SWITCH (1 << 19)
 #define ARVID_COIN_BUTTON (1 << 17)
 #define ARVID_START_BUTTON (1 << 21)
@@ -76,6 +116,24 @@ IN THE PRODUCT.
 #define ARVID_P2_B3 (1 << 26)
 #define ARVID_P2_B4 (1 << 23)
 
+/* batch commands */
+#define ARVID_BATCH_MAX 16
+#define ARVID_BATCH_PREV_RESULT 0x7FFFFFFF
+#define ARVID_BATCH_GET_FRAME_NUMBER 2
+#define ARVID_BATCH_SET_VIDEO_MODE 4
+#define ARVID_BATCH_GET_VIDEO_MODE_LINES 5
+#define ARVID_BATCH_GET_VIDEO_MODE_FREQ 6
+#define ARVID_BATCH_GET_WIDTH 7
+#define ARVID_BATCH_GET_HEIGHT 8
+#define ARVID_BATCH_GET_LINE_POS_MOD 32
+#define ARVID_BATCH_SET_LINE_POS_MOD 33
+#define ARVID_BATCH_SET_VIRTUAL_VSYNC 34
+
+/* latency histograms of the statistics: bucket 0 counts values
+	up to 1 usec, bucket i counts values 2^i - 2^(i+1)-1 usec and the
+	last bucket counts all the longer ones */
+#define ARVID_STAT_HISTOGRAM_SIZE 24
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -85,12 +143,60 @@ typedef struct arvid_client_vmode_info_s {
 	unsigned short vmode; /* video mode number/id */
 } arvid_client_vmode_info; 
 
-/* connects the client to the arvid-server */
+typedef struct arvid_client_batch_s {
+	int count;
+	int command[ARVID_BATCH_MAX];
+	int arg[ARVID_BATCH_MAX][2];
+	int result[ARVID_BATCH_MAX];
+} arvid_client_batch;
+
+typedef struct arvid_client_stats_s {
+	unsigned long long framesBlitted;
+	unsigned long long droppedFrames;	/* vsyncs missed by the blitted frames */
+	unsigned long long bytesOut;		/* frame data and commands */
+	unsigned long long bytesIn;			/* responses and vsync notifications */
+	unsigned long long packetsOut;
+	unsigned long long packetsIn;
+	unsigned long long rawBytes;		/* frame data before compression */
+	unsigned long long compressedBytes;	/* frame data after compression */
+	float compressionRatio;				/* rawBytes / compressedBytes */
+	unsigned long long compressTime;	/* total compression time of all cores (usec) */
+	unsigned long long sendErrors;		/* packets the socket refused to send */
+	unsigned long long commandResends;
+	unsigned long long commandTimeouts;
+	unsigned int vsyncRttLast;			/* vsync request round trip (usec) */
+	unsigned int vsyncRttMin;
+	unsigned int vsyncRttMax;
+	unsigned int compressHist[ARVID_STAT_HISTOGRAM_SIZE];	/* compression time per strip */
+	unsigned int blitHist[ARVID_STAT_HISTOGRAM_SIZE];		/* duration of blit calls */
+	unsigned int vsyncRttHist[ARVID_STAT_HISTOGRAM_SIZE];	/* vsync request round trips */
+} arvid_client_stats;
+
+/* connects the client to the arvid-server 
+	When the server address is a loopback address (127.x.x.x) and the
+	server exposes its shared-memory frame buffer (Linux only), the frames
+	are written straight to the shared memory without compression and
+	the vsync is signalled by the server directly. The other commands
+	are still sent over the network.
+*/
 int arvid_client_connect(char* serverAddress);
 
 /* closes arvid */
 int arvid_client_close(void);
 
+/* sets the command response timeout in milliseconds
+
+Each command waiting for a response is sent once and resent only when
+the response does not arrive within the retransmission timeout that
+is estimated from the measured round trip time. When no response
+arrives within the command timeout (2000 ms by default) the function
+gives up and returns ARVID_CLIENT_ERROR_TIMEOUT (or 0 for functions
+returning frame number and refresh rate).
+
+Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_command_timeout(int timeout);
+
 /* sets the blitting type
 
 * Blocking : blit_buffer function waits till the frame buffer
@@ -117,17 +223,254 @@ Returns 0 on success, negative on failure (invalid argument etc.)
 */
 int arvid_client_set_blit_type(int type);
 
+/* enables (1) or disables (0) the timeline tracing. Each thread records
+	the blit, compression, send, task wait and vsync events into its own
+	ring buffer (the last 16384 events per thread are kept).
+	Call it from the thread which blits the frames.
+	Returns 0 on success.
+*/
+int arvid_client_set_trace(int enable);
+
+/* writes the recorded trace events to the file as Chrome trace JSON
+	(open it in chrome://tracing or Perfetto).
+	Returns the number of written events, negative on failure.
+*/
+int arvid_client_dump_trace(char* fileName);
+
+/* sets the number of CPU cores (compression tasks) to use, 1 - 8.
+	0 uses all the cores of the CPU (default).
+	Has to be called before the connect function.
+	Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_cpu_cores(int cores);
+
+/* enables publishing of the live metrics (Linux only), see arvid_stat.
+	The metrics segment /dev/shm/arvid_metrics.<pid> exists while the
+	client is connected. When this function is not called, the metrics
+	are published only if the ARVID_METRICS environment variable is
+	set to 1. Can be called before or after the connect function.
+	Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_metrics(int enable);
+
+/* sets the way the compressed strips of the frame buffer are sent
+
+* Default (0): each strip is sent by its own system call as soon as
+   it is compressed.
+
+* ARVID_SEND_BATCH: each compression task collects its strips and
+   submits them all by a single sendmmsg() call. This saves the
+   per-packet system call overhead on slow hosts at the cost of
+   sending the first strip of the task a bit later. Linux only.
+
+* ARVID_SEND_ZEROCOPY: the kernel sends the compressed strips directly
+   from the task buffers (MSG_ZEROCOPY) instead of copying them. Each
+   task rotates its strip buffers and reuses a buffer only after the
+   kernel releases it. Saves memory bandwidth on high resolution modes
+   with poorly compressible content. Linux 5.0 and newer only.
+
+Send flags are reset to default when you call the connect function.
+Returns 0 on success, negative on failure (unsupported flag etc.)
+*/
+int arvid_client_set_send_flags(int flags);
+
+/* sets forward error correction of the blit packets
+
+Each group of 'groupSize' consecutive strips is followed by a parity
+packet (XOR of the strip packets). The server can rebuild a single lost
+strip of the group without a retransmission. The bandwidth cost is
+roughly 1 / groupSize of the frame size.
+
+groupSize: 1 - 16 strips per parity packet, 0 to disable FEC (default)
+
+FEC is disabled when you call the connect function.
+Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_fec(int groupSize);
+
+/* enables the frame commit
+
+When enabled, the compression task that sends the last strip of the
+frame follows it by a commit packet with the frame id and the number
+of strips. The server then shows the frame at the first vsync after
+all its strips have arrived, without waiting for the vsync request.
+This removes one network round trip from the blit-to-display latency.
+The wait_for_vsync function still paces the frames, but no longer
+decides when the frame is shown.
+
+Frame commit is disabled when you call the connect function.
+Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_frame_commit(int enable);
+
+/* enables selective retransmission of lost strips
+
+Each blit packet carries its strip index within the frame. When enabled,
+the vsync request tells the server the frame id and the number of strips
+of the last blitted frame and the server returns a bitmap of the strips
+it has not received. Only the missing strips are sent again from the packets
+kept by the compression tasks, without compressing the frame again.
+Suitable for low latency links. Up to 32 strips per frame are covered.
+
+NACK is disabled when you call the connect function.
+Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_nack(int enable);
+
+/* sets transmit pacing of the blit packets
+
+Without pacing the whole frame is sent as a single burst of packets
+which may overflow the receive ring of the server NIC. Pacing spreads
+the packets of the frame over time.
+
+rate: maximal rate in bytes per second,
+      0 for automatic rate derived from the size of the last frame
+      and the refresh rate of the current video mode,
+      negative to disable pacing (default)
+framePercent: automatic rate only - the part of the frame period
+      (1 - 100 %) the packets of the frame are spread over.
+
+Pacing is disabled when you call the connect function.
+Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_tx_pacing(int rate, int framePercent);
+
+/* returns the total time in microseconds the packets of the last
+	frame were delayed by the transmit pacing */
+unsigned int arvid_client_get_tx_pacing_delay(void);
+
 /* sends the video frame to hidden arvid buffer 
+	Each blit packet is tagged with the frame id and the number of
+	strips of the frame, so the server can drop late strips of older
+	frames and show the frame only when all its strips arrived.
 	returns 0 on success, -1 on failure
 */
 int arvid_client_blit_buffer(unsigned short* buffer, int width, int height,  int stride);
 
+/* sends the video frame in the ARVID_FORMAT_xxx pixel format.
+	The stride is in pixels of the format. The pixels are converted
+	to RGB555 by the compression tasks strip by strip, so no converted
+	copy of the whole frame is made.
+	returns 0 on success, negative on failure
+*/
+int arvid_client_blit_buffer_fmt(void* buffer, int width, int height, int stride, int format);
+
+/* sends the video frame scaled to the size of the current video mode.
+	The source rectangle can be of any size, pass the pointer to its
+	top left pixel, its size and the stride of the whole buffer (in pixels
+	of the format). The compression tasks scale their strips directly
+	from the source, so no scaled copy of the frame is made.
+
+	filter:
+	 ARVID_SCALE_NEAREST: nearest pixel
+	 ARVID_SCALE_INTEGER: the largest integer ratio (or 1 / integer when
+	   the source is larger) that fits, centered with black borders
+	 ARVID_SCALE_BILINEAR: bilinear interpolation
+
+	The video mode must be set by arvid_client_set_video_mode before.
+	The capture file records the source rectangle without the scaling.
+	returns 0 on success, negative on failure
+*/
+int arvid_client_blit_scaled(void* buffer, int width, int height, int stride, int format, int filter);
+
+/* sets the dither of the 32 bit pixel formats
+
+The 8 bit channels are converted to 5 bits with the 4x4 ordered (Bayer)
+dither instead of the plain truncation, which removes most of the
+banding of the gradients. The dither is done by the same conversion
+pass, so it costs only a saturated add per pixel.
+
+mode:
+ ARVID_DITHER_NONE: plain truncation (default)
+ ARVID_DITHER_STABLE: the pattern is fixed to the screen position, so
+   the static parts of the frame produce the same pixels every frame
+ ARVID_DITHER_TEMPORAL: the pattern moves every frame, so the dither
+   averages out in time, but static content changes every frame
+
+The dither is disabled when you call the connect function.
+Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_dither(int mode);
+
+/* sets the rotation and the flips of the blitted frames
+
+Vertical (tate) games rendered for the rotated monitor can be shown
+on the monitor turned by 90 degrees, ie. when the ARVID_TATE_SWITCH
+button is pressed. The compression tasks transpose their strips
+directly from the source in 8x8 pixel tiles, so no rotated copy
+of the frame is made.
+
+rotation: one of ARVID_ROTATE_xxx combined with ARVID_FLIP_H and
+  ARVID_FLIP_V (the flips are applied after the rotation)
+
+The size of the rotated frame is swapped by the 90 and 270 degree
+rotations, the scaled blit scales the rotated frame to the video mode.
+The capture file records the frames without the rotation.
+The rotation is reset when you call the connect function.
+Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_rotation(int rotation);
+
+/* sets the color table of the blitted frames
+
+The table has ARVID_LUT_SIZE entries indexed by the RGB555 color and
+holds the RGB555 color that is sent instead, ie. the gamma and color
+temperature correction of the monitor. The compression tasks map each
+strip right before its compression, so it costs no extra pass over
+the frame.
+
+The table is copied, so it can be changed every frame (fades, flashes)
+without waiting for the frames being sent. Pass NULL to disable it.
+The capture file records the frames without the color table.
+The table is disabled when you call the connect function.
+Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_color_lut(const unsigned short* lut);
+
+/* returns the shared-memory frame buffer the next frame should be
+	rendered to and stores its stride (in pixels) to the stride argument.
+	Passing this buffer to the blit_buffer function commits the frame
+	without any copy. Returns NULL when the shared memory is not used.
+*/
+unsigned short* arvid_client_get_frame_buffer(int* stride);
+
+/* starts recording the blitted frames to the capture file
+	(see src/arvid_capture.h), the file is overwritten. Each frame is
+	stored with its dimensions, stride and time stamp and can be replayed
+	by the replay tool. NULL stops the recording.
+	Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_capture_file(char* fileName);
+
 /* returns current frame number */
 unsigned int arvid_client_get_frame_number(void);
 
 /* waits for a vsync then returns current frame number */
 unsigned int arvid_client_wait_for_vsync(void);
 
+/* sets the way wait_for_vsync function waits for the vsync
+
+* ARVID_VSYNC_SERVER: each wait is a request to the server which
+   responds at the vsync. This is the default mode.
+
+* ARVID_VSYNC_LOCAL: the client runs a local vsync clock built from the
+   refresh rate of the video mode and the frame numbers returned by the
+   server. The wait just sleeps till the predicted vsync, so the frame
+   pacing does not depend on the network round trip and its jitter.
+   Every 'syncInterval' frames the wait goes to the server to correct
+   the clock. The button status is updated on the corrections only.
+
+* ARVID_VSYNC_PUSH: the client subscribes once and the server pushes
+   a small notification with the frame number and button status on
+   every vsync. A receiver thread keeps the latest state, so the button
+   status has one-way latency and no request is sent per frame.
+   The syncInterval is ignored. Falls back to a vsync request when no
+   notification arrives within 100 ms.
+
+Returns 0 on success, negative on failure.
+*/
+int arvid_client_set_vsync_mode(int mode, int syncInterval);
+
 /* sets arvid video mode 
 	return 0 on success
 */
@@ -165,6 +508,52 @@ int arvid_client_get_button_status(void);
 the calls of this function */
 unsigned int arvid_client_get_stat_transferred_size(void);
 
+/* fills the transfer statistics collected since the connect or
+	the last arvid_client_reset_stats() call.
+	The counters are kept per compression task and summed up here,
+	so the call does not slow down the blit.
+	returns 0 on success, negative on failure */
+int arvid_client_get_stats(arvid_client_stats* stats);
+
+/* starts collecting the statistics from zero */
+int arvid_client_reset_stats(void);
+
+/* Command batch: several control commands sent in a single
+packet and answered by a single response.
+
+Arguments of the sub-commands:
+ ARVID_BATCH_SET_VIDEO_MODE: mode, lines
+ ARVID_BATCH_GET_VIDEO_MODE_LINES: mode, refresh rate * 1000
+ ARVID_BATCH_GET_VIDEO_MODE_FREQ: mode, lines (result is rate * 1000)
+ ARVID_BATCH_SET_LINE_POS_MOD: modifier
+ ARVID_BATCH_SET_VIRTUAL_VSYNC: vsync line or -1
+ others: no arguments
+The second argument can be ARVID_BATCH_PREV_RESULT to use the result
+of the previous sub-command, ie. a mode switch in a single round trip:
+ arvid_client_batch_init(&b);
+ arvid_client_batch_add(&b, ARVID_BATCH_GET_VIDEO_MODE_LINES, ARVID_320, 60000);
+ arvid_client_batch_add(&b, ARVID_BATCH_SET_VIDEO_MODE, ARVID_320, ARVID_BATCH_PREV_RESULT);
+ arvid_client_batch_add(&b, ARVID_BATCH_GET_WIDTH, 0, 0);
+ arvid_client_batch_add(&b, ARVID_BATCH_GET_HEIGHT, 0, 0);
+ arvid_client_batch_send(&b);
+The local vsync and the automatic transmit pacing need the refresh rate
+of the new mode. Add ARVID_BATCH_GET_VIDEO_MODE_FREQ of the new mode and
+lines to the same batch, otherwise the rate is read by the next
+arvid_client_wait_for_vsync call.
+*/
+
+/* clears the batch */
+void arvid_client_batch_init(arvid_client_batch* batch);
+
+/* adds a sub-command to the batch.
+	returns index of the sub-command result, negative on failure */
+int arvid_client_batch_add(arvid_client_batch* batch, int command, int arg1, int arg2);
+
+/* sends the batch and stores the results of the sub-commands
+	to the batch result array.
+	returns 0 on success, negative on failure */
+int arvid_client_batch_send(arvid_client_batch* batch);
+
 /* set the line position modifier */
 int arvid_client_set_line_pos_mod(short mod);
 
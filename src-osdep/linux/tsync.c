@@ -2,6 +2,7 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <sched.h>
+#include <time.h>
 
 #include "tsync.h"
 
@@ -32,8 +33,20 @@ void tsync_mutex_wait(tsync_mutex* mutex) {
 	sem_wait(mutex);
 }
 
-void tsync_thread_start(tsync_thread* thread, void*(*func)(void*), void* data) {
-	pthread_create(thread, NULL, (void*) func, data);
+int tsync_mutex_wait_timeout(tsync_mutex* mutex, int ms) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	return sem_timedwait(mutex, &ts) == 0 ? 0 : 1;
+}
+
+int tsync_thread_start(tsync_thread* thread, void*(*func)(void*), void* data) {
+	return pthread_create(thread, NULL, (void*) func, data) == 0 ? 0 : -1;
 }
 
 /* get the number of active CPU cores */
@@ -121,3 +134,17 @@ void tsync_thread_set_cpu(int cpuIndex) {
 	}
 }
 
+/* returns monotonic time in microseconds */
+unsigned long long tsync_get_time_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* sleeps the calling thread for specified number of microseconds */
+void tsync_sleep_us(unsigned int us) {
+	struct timespec ts;
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+}
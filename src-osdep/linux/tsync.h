@@ -23,11 +23,15 @@ void tsync_mutex_signal(tsync_mutex* mutex);
 /* wait tsync mutex */
 void tsync_mutex_wait(tsync_mutex* mutex);
 
+/* wait tsync mutex at most 'ms' milliseconds.
+   returns 0 when signalled, 1 on timeout */
+int tsync_mutex_wait_timeout(tsync_mutex* mutex, int ms);
+
 
 typedef pthread_t tsync_thread;
 
-/* creates and starts a thread */
-void tsync_thread_start(tsync_thread* thread, void*(*func)(void*), void* data);
+/* creates and starts a thread, returns 0 on success */
+int tsync_thread_start(tsync_thread* thread, void*(*func)(void*), void* data);
 
 /* get the number of active CPU cores */
 int tsync_get_cpu_cores(void);
@@ -35,5 +39,11 @@ int tsync_get_cpu_cores(void);
 /* schedules thread on particular processor */
 void tsync_thread_set_cpu(int cpuIndex);
 
+/* returns monotonic time in microseconds */
+unsigned long long tsync_get_time_us(void);
+
+/* sleeps the calling thread for specified number of microseconds */
+void tsync_sleep_us(unsigned int us);
+
 
 #endif
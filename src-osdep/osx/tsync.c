@@ -3,6 +3,7 @@
 #include <stdio.h>
 
 #include <mach/thread_policy.h>
+#include <mach/mach_time.h>
 
 #include "tsync.h"
 
@@ -27,8 +28,19 @@ void tsync_mutex_wait(tsync_mutex* mutex) {
 	pthread_mutex_lock(mutex);
 }
 
-void tsync_thread_start(tsync_thread* thread, void*(*func)(void*), void* data) {
-	pthread_create(thread, NULL, (void*) func, data);
+int tsync_mutex_wait_timeout(tsync_mutex* mutex, int ms) {
+	//no timed lock on OSX, poll every millisecond
+	while (pthread_mutex_trylock(mutex) != 0) {
+		if (ms-- <= 0) {
+			return 1;
+		}
+		usleep(1000);
+	}
+	return 0;
+}
+
+int tsync_thread_start(tsync_thread* thread, void*(*func)(void*), void* data) {
+	return pthread_create(thread, NULL, (void*) func, data) == 0 ? 0 : -1;
 }
 
 /* get the number of active CPU cores */
@@ -59,3 +71,16 @@ void tsync_thread_set_cpu(int cpuIndex) {
 
 }
 
+/* returns monotonic time in microseconds */
+unsigned long long tsync_get_time_us(void) {
+	static mach_timebase_info_data_t timebase;
+	if (timebase.denom == 0) {
+		mach_timebase_info(&timebase);
+	}
+	return mach_absolute_time() * timebase.numer / timebase.denom / 1000;
+}
+
+/* sleeps the calling thread for specified number of microseconds */
+void tsync_sleep_us(unsigned int us) {
+	usleep(us);
+}
@@ -25,8 +25,13 @@ void tsync_mutex_wait(tsync_mutex* mutex) {
 	WaitForSingleObject(*mutex, INFINITE);
 }
 
-void tsync_thread_start(tsync_thread* thread, void*(*func)(void*), void* data) {
+int tsync_mutex_wait_timeout(tsync_mutex* mutex, int ms) {
+	return WaitForSingleObject(*mutex, ms) == WAIT_OBJECT_0 ? 0 : 1;
+}
+
+int tsync_thread_start(tsync_thread* thread, void*(*func)(void*), void* data) {
 	*thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) func, data, 0, NULL);
+	return *thread != NULL ? 0 : -1;
 }
 /* get the number of active CPU cores */
 int tsync_get_cpu_cores(void) {
@@ -41,3 +46,26 @@ void tsync_thread_set_cpu(int cpuIndex) {
 	//ignore - Windows seems to schedule threads fine and spreads the CPU load equally
 }
 
+/* returns monotonic time in microseconds */
+unsigned long long tsync_get_time_us(void) {
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+	return (unsigned long long) (counter.QuadPart / frequency.QuadPart) * 1000000 +
+		(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+/* sleeps the calling thread for specified number of microseconds */
+void tsync_sleep_us(unsigned int us) {
+	unsigned long long end = tsync_get_time_us() + us;
+	//Sleep() has 1 ms resolution at best, busy wait the rest
+	if (us > 2000) {
+		Sleep((us - 1000) / 1000);
+	}
+	while (tsync_get_time_us() < end) {
+		Sleep(0);
+	}
+}
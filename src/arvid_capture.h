@@ -0,0 +1,58 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+#ifndef _ARVID_CAPTURE_H_
+#define _ARVID_CAPTURE_H_
+
+/*
+Frame capture file written by arvid_client_set_capture_file().
+
+The file starts with the capture header followed by the frames. Each
+frame is a frame header followed by width * height RGB555 pixels (the
+stride padding is not stored) padded by zeros to a multiple of 8 bytes.
+All values are in the byte order of the recording machine.
+*/
+
+#define ARVID_CAPTURE_MAGIC 0x43445641
+#define ARVID_CAPTURE_VERSION 1
+
+typedef struct arvid_capture_header_t {
+	unsigned int magic;			//ARVID_CAPTURE_MAGIC
+	unsigned int version;		//ARVID_CAPTURE_VERSION
+	unsigned int headerSize;	//size of this header
+	unsigned int frameHeaderSize;	//size of the frame header
+} arvid_capture_header;
+
+typedef struct arvid_capture_frame_t {
+	unsigned int size;			//size of the pixel data including the padding
+	unsigned short width;
+	unsigned short height;
+	unsigned short stride;		//stride of the blitted buffer
+	unsigned short reserved;
+	unsigned int index;			//frame index
+	unsigned long long time;	//time since the start of the capture (usec)
+} arvid_capture_frame;
+
+#endif
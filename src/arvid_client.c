@@ -25,32 +25,66 @@ IN THE PRODUCT.
 
 /* Arvid udp client - support multi-threaded frame buffer compression */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
 
 #ifdef MINGW
 #include <winsock2.h>
 #include <windows.h>
 #define PAYLOAD_TYPE (const char *)
 #define MSG_DONTWAIT 0
-#define OS_DONTWAIT(v,s) {u_long mode=v; ioctlsocket(s,FIONBIO,&mode);}
 #else
 #include <sys/socket.h>
+#include <sys/select.h>
 #include <netinet/in.h>
 #define PAYLOAD_TYPE
-#define OS_DONTWAIT(v,s)
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <pthread.h>
+#include <linux/errqueue.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+//older libc headers may miss the zero-copy definitions
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <memory.h>
 #include "zlib.h"
 
 #include "tsync.h"
 #include "crc.h"
+#include "trace.h"
+#include "pixconv.h"
+#include "arvid_shm.h"
+#include "arvid_capture.h"
+#include "arvid_metrics.h"
 #include "arvid_client.h"
 
 #define ARVID_CLIENT_VERSION "0.4f"
 
 
 #define CMD_BLIT 1
+#define CMD_BLIT_PARITY 13
+#define CMD_COMMIT_FRAME 14
+#define CMD_BATCH 15
 #define CMD_FRAME_NUMBER 2
 #define CMD_VSYNC 3
 #define CMD_SET_VIDEO_MODE 4
@@ -61,6 +95,8 @@ IN THE PRODUCT.
 #define CMD_ENUM_VIDEO_MODES 9 
 #define CMD_INIT 11
 #define CMD_CLOSE 12
+#define CMD_SUBSCRIBE_VSYNC 16
+#define CMD_VSYNC_PUSH 17
 
 #define CMD_GET_LINE_MOD 32
 #define CMD_SET_LINE_MOD 33
@@ -83,7 +119,7 @@ IN THE PRODUCT.
 #define GET_INT(x) ((x[0] << 24) | (x[1] << 16) | (x[2] << 8) | x[3])
 #define GET_SHORT(x) ((x[0] << 8) | x[1])
 #else
-#define SET_SHORT(x) ((unsigned short) (x & 0xFFFF));
+#define SET_SHORT(x) ((unsigned short) (x & 0xFFFF))
 #define GET_INT(x) (((int)x[3] << 24) | ((int)x[2] << 16) | ((int)x[1] << 8) | x[0])
 #define GET_SHORT(x) (((int)x[1] << 8) | x[0])
 #endif
@@ -93,35 +129,245 @@ IN THE PRODUCT.
 #define PACKET_CNT 3
 #define RESPONSE_SIZE 6
 
+//command retransmission timeout bounds (usec)
+#define CMD_RTO_INIT 100000
+#define CMD_RTO_MIN 5000
+#define CMD_RTO_MAX 1000000
+//default time to give up waiting for a command response (msec)
+#define CMD_TIMEOUT 2000
+//extra time the server needs to process some commands (msec)
+#define CMD_VSYNC_WAIT 21
+#define CMD_VIDEO_MODE_WAIT 100
+#define CMD_UPDATE_WAIT 1000
+
+//batch sub-command flag: use the result of the previous sub-command
+//as the second argument
+#define BATCH_ARG2_PREV 0x8000
+
+//vsync notification pushed by the server:
+//command (2 bytes), frame number (4 bytes), button status (4 bytes)
+#define VSYNC_PUSH_SIZE 10
+//max. time to wait for the vsync receiver thread to stop (ms)
+#define PUSH_STOP_WAIT 1000
+
+//local vsync wakes up a bit after the predicted vsync, so the server
+//vsync correction that follows never returns the same frame (usec)
+#define VSYNC_LOCAL_MARGIN 250
+
+//blit packet: 8 shorts of header followed by the compressed data
+// [0] CMD_BLIT
+// [1] compressed data size in bytes
+// [2] y position of the first line
+// [3] strip index within the frame
+// [4] frame id (lower 16 bits of the blitted frame counter)
+// [5] number of strips of the frame
+// [6] width of the lines (0 - width of the video mode)
+// [7] reserved (0)
+//parity packet uses the same header size:
+// [0] CMD_BLIT_PARITY
+// [1] parity data size in bytes
+// [2] y position of the first strip of the group
+// [3] number of strips in the group
+// [4] lines per strip
+// [5] frame id
+// [6] - [7] reserved (0)
+#define PACKET_HEADER_SIZE 8
+#define PACKET_PAYLOAD_SIZE (16 * 1024 + 64)
+//number of blit packets each task can hold before reusing them: all
+//the strips the server can report missing, each with its own parity
+//packet (FEC group of 1), so a NACK never asks for an evicted strip
+#define PACKET_SLOTS (NACK_MAX_STRIPS * 2)
+
+//lines per strip: max size of single chunk is 32 Kbytes
+#define STRIP_LINES(stride) ((stride) > 512 ? 16 : 32)
+
+//lines of the rotated frame rendered at once into the shared memory
+#define SHM_ORIENT_LINES 32
+
+//vsync response with the bitmap of missing strips
+#define VSYNC_RESPONSE_SIZE 10
+#define VSYNC_NACK_RESPONSE_SIZE 14
+#define NACK_MAX_STRIPS 32
+
+//maximal number of strips protected by a single parity packet
+#define FEC_MAX_GROUP 16
+
+//bytes the transmit pacer lets through without delay
+#define PACING_BURST (16 * 1024)
+
+//mapping of the destination pixels to the source pixels of the scaler
+typedef struct arvid_client_scale_t {
+	int filter;					//ARVID_SCALE_xxx
+	int srcWidth;
+	int srcHeight;
+	int width;					//destination size
+	int height;
+	int* xMap;					//source column of each destination column, -1 - border
+	int* yMap;					//source line of each destination line, -1 - border
+	unsigned short* xWeight;	//weight of the next source column (0 - 255)
+	unsigned short* yWeight;	//weight of the next source line (0 - 255)
+} arvid_client_scale;
+
+//conversion of the source pixels to RGB555
+typedef struct arvid_client_conv_t {
+	pixconv_func convert;		//NULL - the source is RGB555
+	pixconv_dither_func dither;	//used instead of convert when set
+	int pixelSize;				//bytes per source pixel
+	unsigned int ditherPattern[4][4];
+	arvid_client_scale* scale;	//NULL - the source is not scaled
+	char orient;				//the source is rotated or flipped
+	char transpose;				//source columns are the destination lines
+	char mirrorX;				//the destination lines are reversed
+	char mirrorY;				//the destination lines go bottom-up
+	const unsigned short* lut;	//color table of the frame, NULL - not used
+	int srcWidth;				//size of the source
+	int srcHeight;
+	int srcStride;				//stride of the source in pixels
+} arvid_client_conv;
+
+//transfer counters, each set is updated by a single thread only and
+//all the sets are summed up when the statistics are read. Aligned to
+//the cache line, so the tasks do not fight for the same line.
+typedef struct arvid_client_counters_t {
+	unsigned long long bytesOut;
+	unsigned long long packetsOut;
+	unsigned long long bytesIn;
+	unsigned long long packetsIn;
+	unsigned long long rawBytes;
+	unsigned long long compressedBytes;
+	unsigned long long compressTime;	//usec
+	unsigned long long sendErrors;
+	unsigned int compressHist[ARVID_STAT_HISTOGRAM_SIZE];
+} __attribute__((aligned(64))) arvid_client_counters;
+
 typedef struct arvid_client_data_t {
 	int socketFd;
 	struct sockaddr_in serverAddr;
 	struct sockaddr_in clientAddr;
 	unsigned short payload [1 * 1024 + 8];
 	unsigned short recv[128]; //previously 12, now list of videomodes can be send back so it is larger
-	unsigned long statSize;			//transferred size
+	int recvSize;					//size of the last received response
+	int cmdSize;					//size of the last command in shorts
+	unsigned long long cmdTime;		//time the last command was sent (usec)
+	char cmdResent;					//last command had to be resent
+	int cmdTimeout;					//command response timeout (msec)
+	int srtt;						//smoothed round trip time (usec)
+	int rttVar;						//round trip time variation (usec)
+	int rto;						//retransmission timeout (usec)
+	unsigned long long recvTime;	//time the last response arrived (usec)
 	int width;
 	int height;
 	int cpuCores;					//total number of cores to use
 	int blitType;
+	int sendFlags;					//ARVID_SEND_xxx flags
+	int fecGroup;					//strips per parity packet, 0 - no FEC
+	char nack;						//resend strips reported missing by the server
+	char frameCommit;				//commit each frame right after its last strip
+	volatile int tasksRunning;		//tasks still compressing the current frame
+	unsigned int frameCount;		//number of blitted frames
+	int frameStrips;				//number of strips of the last blitted frame
 	char opened;
 	char blitWait;
 	int buttons;				//button status
+	int videoMode;				//last set video mode
+	int videoLines;
+	float refreshRate;			//refresh rate of the last set video mode
+	int pacingRate;				//bytes per second, 0 - automatic, negative - off
+	int pacingPercent;			//part of the frame period used by automatic pacing
+	int pacingRateFrame;		//effective pacing rate of the current frame
+	volatile unsigned long long pacingTat;	//theoretical arrival time of the next packet
+	volatile unsigned int pacingDelay;		//pacing delay of the current frame (usec)
+	unsigned int pacingDelayLast;			//pacing delay of the last frame (usec)
+	volatile unsigned int frameBytes;		//bytes sent in the current frame
+	unsigned int frameBytesLast;			//bytes sent in the last frame
+	int vsyncMode;				//ARVID_VSYNC_xxx
+	int vsyncSyncInterval;		//frames between server vsync corrections
+	int vsyncLocalFrames;		//frames predicted since the last correction
+	char vsyncModelStale;		//the video mode changed, reset the model at the next vsync
+	int vsyncSamples;			//server vsyncs the model is based on
+	unsigned int vsyncFrame;	//frame number of the reference vsync
+	unsigned long long vsyncTime;	//time of the reference vsync (usec)
+	double vsyncPeriod;			//estimated frame period (usec)
+	double vsyncNominal;		//frame period of the video mode (usec)
+	unsigned int vsyncLastFrame;	//last frame number returned by vsync wait
+	int pushFd;					//socket receiving the vsync notifications
+	unsigned short pushPort;
+	tsync_thread pushThread;
+	tsync_mutex pushSignal;		//signalled on each vsync notification
+	volatile unsigned int pushFrame;	//frame number of the last notification
+	volatile char pushStop;
+	volatile char pushRunning;	//cleared by the receiver thread when it ends
+	arvid_shm_header* shm;		//frame buffer shared by the local server
+	unsigned int shmSize;
+	FILE* captureFile;			//frames are recorded to this file
+	unsigned long long captureStart;	//time the capture started (usec)
+	unsigned int captureFrames;
+	arvid_client_counters counters;		//commands and responses (main thread)
+	arvid_client_counters pushCounters;	//vsync notifications (push thread)
+	unsigned long long commandResends;
+	unsigned long long commandTimeouts;
+	unsigned int vsyncRttLast;
+	unsigned int vsyncRttMin;
+	unsigned int vsyncRttMax;
+	unsigned int blitHist[ARVID_STAT_HISTOGRAM_SIZE];
+	unsigned int vsyncRttHist[ARVID_STAT_HISTOGRAM_SIZE];
+	unsigned long long droppedFrames;	//vsyncs missed by the blitted frames
+	int ditherMode;						//ARVID_DITHER_xxx
+	unsigned short* lutBuffer;			//2 color tables: in use and the next one
+	unsigned short* lut;				//color table of the next frame, NULL - not used
+	const unsigned short* lutSent;		//color table of the last blitted frame
+	int rotation;						//ARVID_ROTATE_xxx and ARVID_FLIP_xxx
+	arvid_client_scale scale;			//scaler of the last scaled blit
+	unsigned int vsyncBlitFrame;		//frame count at the last vsync wait
+	arvid_client_stats statBase;		//statistics at the last reset
+	unsigned long long statSizeLast;	//blit bytes at the last transferred size query
+	arvid_metrics* metrics;				//live metrics segment
+	unsigned long long metricsTime;		//start of the fps measurement (usec)
+	unsigned long long metricsFrames;	//frames at the start of the measurement
+	unsigned long long metricsBytes;	//bytes at the start of the measurement
 } arvid_client_data;
 
+//compressed blit packet ready to be sent
+typedef struct arvid_client_packet_t {
+	unsigned short* data;		//points to the buffer, or to a replacement of it
+	unsigned short buffer[PACKET_PAYLOAD_SIZE];
+	int size;					//packet size in bytes
+	int strip;					//strip index within the frame, -1 for parity
+	unsigned int frame;			//frame the packet belongs to
+	unsigned int zcId;			//zero-copy notification id
+	volatile char zcPending;	//kernel still references the data
+} arvid_client_packet;
+
 //data passed to compression threads
 typedef struct arvid_client_task_t {
 	tsync_thread thread;
 	tsync_mutex mutexStart;	//start of the job
 	tsync_mutex mutexEnd;	//finished the job
 	z_stream zStream;
-	unsigned short* buffer;		//frame buffer start (source data)
-	unsigned short payload [16 * 1024 + 8];	//destination (compressed) data
+	unsigned char* buffer;		//frame buffer start (source data)
+	arvid_client_conv conv;		//conversion of the source pixels
+	unsigned short* convBuffer;	//converted pixels of the current strip
+	int convSize;				//size of the converted strip buffer in pixels
+	unsigned short* scaleBuffer;	//source line and cached lines of the scaler
+	int scaleSize;				//size of the scaler buffer in pixels
+	unsigned short* scaledRow[2];	//source lines scaled horizontally
+	int scaledRowY[2];			//source line of the cached line, -1 - none
+	int scaledRowNext;			//cache slot to replace next
+	unsigned short* orientBuffer;	//converted band of the source columns
+	unsigned char* gatherBuffer;	//source pixels of a single line
+	int orientSize;				//size of the orientation buffers in bytes
+	arvid_client_packet packet[PACKET_SLOTS];	//destination (compressed) data
+	int packetIndex;			//next free packet slot
+	int batchStart;				//first slot of the unsent packets
+	int batchCount;				//number of unsent packets
 	int yPos;					//initial line
 	int width;
 	int height;					//lines to transfer
 	int stride;					//stride of a single line
+	int stripIndex;				//index of the first strip within the frame
+	int frameStrips;			//number of strips of the whole frame
 	int taskIndex;
+	arvid_client_counters counters;
 	volatile char started;
 	volatile char stopped;
 } arvid_client_task;
@@ -129,9 +375,32 @@ typedef struct arvid_client_task_t {
 arvid_client_data ac;
 arvid_client_task at[MAX_TASK]; 
 
+static int cpuCoresLimit = 0;
+//live metrics: -1 - by the ARVID_METRICS environment variable, 0 - off, 1 - on
+static int metricsEnabled = -1;
+static const char* taskName_[MAX_TASK] = {
+	"main", "task 1", "task 2", "task 3", "task 4", "task 5", "task 6", "task 7"
+};
 static unsigned short sendId = 0;
 static unsigned short recvId = 0;
 
+#ifdef __linux__
+//guards zero-copy notification ids and the socket error queue
+static pthread_mutex_t zcLock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int zcNextId = 0;
+static void readZeroCopyCompletions_(void);
+#endif
+
+// Counts the value (usec) in the log2 bucket of the histogram.
+static void histAdd_(unsigned int* hist, unsigned long long value) {
+	int bucket = 0;
+	while (value > 1 && bucket < ARVID_STAT_HISTOGRAM_SIZE - 1) {
+		value >>= 1;
+		bucket++;
+	}
+	hist[bucket]++;
+}
+
 static void sleep_(int ms) {
 	#ifdef MINGW
 	Sleep(ms);
@@ -142,41 +411,130 @@ static void sleep_(int ms) {
 }
 
 
-static int receiveResult_(int dataSize ) {
-	unsigned short id = recvId;
-	unsigned char* data = (unsigned char*) ac.recv;
-//	printf("recv..\n");
-	//receive result from the server
-	while(1) {
-	    int size = recvfrom(ac.socketFd, data, dataSize, 0, NULL,NULL);
-	    id = (unsigned short) GET_SHORT(data);
-	    //ignore packets with the same id
-	    if (id != recvId) {
-		break;
-	    }
-	}
-	recvId = id;
-	data += 2; //skip the id
-	return (int) GET_INT(data);
+// Updates the round trip time estimate and the retransmission timeout
+// (RFC 6298) from the response time of a command that was sent once.
+static void updateRto_(int rtt) {
+	if (ac.srtt == 0) {
+		ac.srtt = rtt;
+		ac.rttVar = rtt / 2;
+	} else {
+		int delta = ac.srtt > rtt ? ac.srtt - rtt : rtt - ac.srtt;
+		ac.rttVar = (3 * ac.rttVar + delta) / 4;
+		ac.srtt = (7 * ac.srtt + rtt) / 8;
+	}
+	ac.rto = ac.srtt + 4 * ac.rttVar;
+	if (ac.rto < CMD_RTO_MIN) {
+		ac.rto = CMD_RTO_MIN;
+	} else
+	if (ac.rto > CMD_RTO_MAX) {
+		ac.rto = CMD_RTO_MAX;
+	}
+}
+
+// Waits till the socket is readable. Returns positive value when
+// readable, 0 on timeout.
+static int waitSocket_(unsigned int us) {
+	fd_set readSet;
+	struct timeval tv;
+
+	FD_ZERO(&readSet);
+	FD_SET(ac.socketFd, &readSet);
+	tv.tv_sec = us / 1000000;
+	tv.tv_usec = us % 1000000;
+	return select(ac.socketFd + 1, &readSet, NULL, NULL, &tv);
 }
-static int receiveResultNonBlocking_(void) {
+
+// Receives the response of the last command sent by sendCommand_.
+// The command is resent when the response does not arrive within the
+// retransmission timeout, doubling the timeout every time. 'serverTime'
+// is the time (msec) the server needs to process the command on top of
+// the network round trip (ie. waiting for vsync).
+// Returns the result of the command or ARVID_CLIENT_ERROR_TIMEOUT
+// when no response arrived till the command timeout.
+static int receiveResultWait_(int dataSize, int serverTime) {
 	unsigned char* data = (unsigned char*) ac.recv;
-//	printf("recv..\n");
-	//receive result from the server
+	unsigned long long deadline = ac.cmdTime + (unsigned long long) (ac.cmdTimeout + serverTime) * 1000;
+	unsigned int backoff = ac.rto;
+	unsigned long long resend = ac.cmdTime + backoff + serverTime * 1000;
 
-	//set non-blocking mode
-	OS_DONTWAIT(1, ac.socketFd);
-	int size = recvfrom(ac.socketFd, data, 6, MSG_DONTWAIT, NULL,NULL);
+	//receive result from the server
+	while(1) {
+		unsigned long long now = tsync_get_time_us();
+		unsigned long long wake = resend < deadline ? resend : deadline;
 
-	//set blocking mode
-	OS_DONTWAIT(0, ac.socketFd);
-	if (size >= 0) {
-	    recvId = (unsigned short) GET_SHORT(data);
+		if (now >= deadline) {
+			printf("arvid_client: command %i timed out\n", ac.payload[0]);
+			ac.commandTimeouts++;
+			return ARVID_CLIENT_ERROR_TIMEOUT;
+		}
+		if (now >= resend) {
+			sendto(ac.socketFd, PAYLOAD_TYPE ac.payload, 2 * ac.cmdSize, 0,
+				(struct sockaddr *)& ac.serverAddr, sizeof(ac.serverAddr));
+			ac.cmdResent = 1;
+			ac.commandResends++;
+			ac.counters.bytesOut += 2 * ac.cmdSize;
+			ac.counters.packetsOut++;
+			TRACE_INSTANT(TRACE_RESEND, ac.payload[0]);
+			backoff <<= 1;
+			if (backoff > CMD_RTO_MAX) {
+				backoff = CMD_RTO_MAX;
+			}
+			resend = now + backoff + serverTime * 1000;
+			continue;
+		}
+		if (waitSocket_((unsigned int) (wake - now)) > 0) {
+			int size = recvfrom(ac.socketFd, data, dataSize, MSG_DONTWAIT, NULL,NULL);
+			if (size > 0) {
+				ac.counters.bytesIn += size;
+				ac.counters.packetsIn++;
+			}
+			//ignore responses of older commands
+			if (size >= 2 && (unsigned short) GET_SHORT(data) == sendId) {
+				//Karn's rule: resent commands give ambiguous round trip time
+				if (!ac.cmdResent && serverTime == 0) {
+					updateRto_((int) (tsync_get_time_us() - ac.cmdTime));
+				}
+				ac.recvSize = size;
+				ac.recvTime = tsync_get_time_us();
+				recvId = sendId;
+				data += 2; //skip the id
+				return (int) GET_INT(data);
+			}
+#ifdef __linux__
+			//zero-copy notifications make the socket readable too
+			if (size < 0 && (ac.sendFlags & ARVID_SEND_ZEROCOPY)) {
+				pthread_mutex_lock(&zcLock);
+				readZeroCopyCompletions_();
+				pthread_mutex_unlock(&zcLock);
+			}
+#endif
+		}
 	}
-	return size;
 }
 
+static int receiveResult_(int dataSize) {
+	return receiveResultWait_(dataSize, 0);
+}
+
+// Sends a command which is responded by the server. Use receiveResult_
+// to get the response, it also takes care of resending the command.
 static int sendCommand_(int size) {
+	ac.payload[1] = ++sendId;
+	size++;
+
+	ac.cmdSize = size;
+	ac.cmdResent = 0;
+	ac.cmdTime = tsync_get_time_us();
+	ac.counters.bytesOut += 2 * size;
+	ac.counters.packetsOut++;
+	return sendto(ac.socketFd,  PAYLOAD_TYPE ac.payload, 2 * size, 0,
+		(struct sockaddr *)& ac.serverAddr, sizeof(ac.serverAddr));
+}
+
+// Sends a command which is not responded by the server. Without
+// the response the only protection against a packet loss
+// is sending the command several times.
+static int sendCommandNoReply_(int size) {
 	int i;
 	int result = 0;
 	ac.payload[1] = ++sendId;
@@ -186,14 +544,463 @@ static int sendCommand_(int size) {
 		result = sendto(ac.socketFd,  PAYLOAD_TYPE ac.payload, 2 * size, 0,
 			(struct sockaddr *)& ac.serverAddr, sizeof(ac.serverAddr));
 	}
+	ac.counters.bytesOut += PACKET_CNT * 2 * size;
+	ac.counters.packetsOut += PACKET_CNT;
 
 	return result;
 }
 static void sendCommandWithPayload_(unsigned short* payload, int size) {
+	ac.counters.bytesOut += 2 * size;
+	ac.counters.packetsOut++;
 	sendto(ac.socketFd, PAYLOAD_TYPE payload, 2 * size, 0,
 		(struct sockaddr *)& ac.serverAddr, sizeof(ac.serverAddr));
 }
 
+#ifdef __linux__
+// Marks packets with zero-copy ids in range lo - hi (including)
+// as released by the kernel.
+static void releaseZeroCopyPackets_(unsigned int lo, unsigned int hi) {
+	int i, j;
+	for (i = 0; i < ac.cpuCores; i++) {
+		for (j = 0; j < PACKET_SLOTS; j++) {
+			arvid_client_packet* packet = &at[i].packet[j];
+			//unsigned arithmetics handles the id wrap-around
+			if (packet->zcPending && (packet->zcId - lo) <= (hi - lo)) {
+				packet->zcPending = 0;
+			}
+		}
+	}
+}
+
+// Reads all zero-copy completion notifications queued on the socket
+// error queue. Must be called with zcLock locked.
+static void readZeroCopyCompletions_(void) {
+	char control[128];
+	struct msghdr msg;
+	struct cmsghdr* cm;
+
+	while (1) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(ac.socketFd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			return;
+		}
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err* err;
+			if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR) {
+				continue;
+			}
+			err = (struct sock_extended_err*) CMSG_DATA(cm);
+			if (err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+				releaseZeroCopyPackets_(err->ee_info, err->ee_data);
+			}
+		}
+	}
+}
+
+// Waits till the kernel releases the packet sent by the zero-copy path,
+// so its data can be overwritten.
+static void waitZeroCopyPacket_(arvid_client_packet* packet) {
+	int i;
+	for (i = 0; packet->zcPending; i++) {
+		struct pollfd pfd;
+
+		pthread_mutex_lock(&zcLock);
+		readZeroCopyCompletions_();
+		pthread_mutex_unlock(&zcLock);
+		if (!packet->zcPending) {
+			return;
+		}
+		//give up after 1 second rather than blocking the blit forever:
+		//the kernel may still send from the data, so the slot gets new
+		//data memory (the old one is never reused) and the following
+		//packets are sent by copy
+		if (i >= 1000) {
+			unsigned short* data = (unsigned short*) malloc(sizeof(packet->buffer));
+			if (data == NULL) {
+				continue;
+			}
+			printf("arvid_client: zero-copy completion timed out, zero-copy disabled\n");
+			ac.sendFlags &= ~ARVID_SEND_ZEROCOPY;
+			packet->data = data;
+			packet->zcPending = 0;
+			return;
+		}
+		//error queue notification wakes up the poll
+		pfd.fd = ac.socketFd;
+		pfd.events = 0;
+		pfd.revents = 0;
+		poll(&pfd, 1, 1);
+	}
+}
+#endif
+
+// Transmit pacer (token bucket implemented as the generic cell rate
+// algorithm). Delays the caller till 'bytes' can be sent without
+// exceeding the pacing rate of the current frame. Short bursts up to
+// PACING_BURST bytes pass without delay. Lock-free, so all the tasks
+// share the same bucket.
+static void pace_(int bytes) {
+	unsigned long long now;
+	unsigned long long tat;
+	unsigned long long tolerance;
+	unsigned long long cost;
+	int rate = ac.pacingRateFrame;
+
+	if (rate <= 0) {
+		return;
+	}
+	cost = (unsigned long long) bytes * 1000000 / rate;
+	tolerance = (unsigned long long) PACING_BURST * 1000000 / rate;
+	now = tsync_get_time_us();
+	do {
+		tat = ac.pacingTat;
+	} while (!__sync_bool_compare_and_swap(&ac.pacingTat, tat, (tat > now ? tat : now) + cost));
+
+	if (tat > now + tolerance) {
+		unsigned int delay = (unsigned int) (tat - tolerance - now);
+		TRACE_INSTANT(TRACE_PACING, delay);
+		tsync_sleep_us(delay);
+		__sync_fetch_and_add(&ac.pacingDelay, delay);
+	}
+}
+
+// Sends 'count' blit packets of the task starting at the slot 'first'.
+// In batch mode all the packets are submitted by a single sendmmsg()
+// call, otherwise each packet is sent by its own sendto() call.
+// In zero-copy mode the kernel sends the packet data directly from
+// the packet slots, so the slots are marked pending till the kernel
+// notifies their release. The statistics go to 'counters', which
+// must be owned by the calling thread.
+static void sendPackets_(arvid_client_task* td, int first, int count, arvid_client_counters* counters) {
+	int i;
+	int bytes = 0;
+
+	for (i = 0; i < count; i++) {
+		bytes += td->packet[first + i].size;
+	}
+	pace_(bytes);
+	TRACE_BEGIN(TRACE_SEND, bytes);
+	__sync_fetch_and_add(&ac.frameBytes, bytes);
+	counters->bytesOut += bytes;
+	counters->packetsOut += count;
+#ifdef __linux__
+	int zeroCopy = ac.sendFlags & ARVID_SEND_ZEROCOPY;
+	int flags = zeroCopy ? MSG_ZEROCOPY : 0;
+
+	//notification ids are assigned in the order of the send calls
+	if (zeroCopy) {
+		pthread_mutex_lock(&zcLock);
+	}
+	if (ac.sendFlags & ARVID_SEND_BATCH) {
+		struct mmsghdr msg[PACKET_SLOTS];
+		struct iovec iov[PACKET_SLOTS];
+		int sent = 0;
+
+		memset(msg, 0, sizeof(struct mmsghdr) * count);
+		for (i = 0; i < count; i++) {
+			arvid_client_packet* packet = &td->packet[first + i];
+			iov[i].iov_base = packet->data;
+			iov[i].iov_len = packet->size;
+			msg[i].msg_hdr.msg_name = &ac.serverAddr;
+			msg[i].msg_hdr.msg_namelen = sizeof(ac.serverAddr);
+			msg[i].msg_hdr.msg_iov = &iov[i];
+			msg[i].msg_hdr.msg_iovlen = 1;
+		}
+		//the kernel may accept only part of the batch
+		while (sent < count) {
+			int result = sendmmsg(ac.socketFd, &msg[sent], count - sent, flags);
+			if (result <= 0) {
+				counters->sendErrors += count - sent;
+				break;
+			}
+			if (zeroCopy) {
+				for (i = sent; i < sent + result; i++) {
+					td->packet[first + i].zcId = zcNextId++;
+					td->packet[first + i].zcPending = 1;
+				}
+			}
+			sent += result;
+		}
+	} else {
+		for (i = 0; i < count; i++) {
+			arvid_client_packet* packet = &td->packet[first + i];
+			int result = sendto(ac.socketFd, packet->data, packet->size, flags,
+				(struct sockaddr *)& ac.serverAddr, sizeof(ac.serverAddr));
+			if (result < 0) {
+				counters->sendErrors++;
+			}
+			if (zeroCopy && result >= 0) {
+				packet->zcId = zcNextId++;
+				packet->zcPending = 1;
+			}
+		}
+	}
+	if (zeroCopy) {
+		//keep the error queue short
+		readZeroCopyCompletions_();
+		pthread_mutex_unlock(&zcLock);
+	}
+#else
+	for (i = 0; i < count; i++) {
+		arvid_client_packet* packet = &td->packet[first + i];
+		if (sendto(ac.socketFd, PAYLOAD_TYPE packet->data, packet->size, 0,
+			(struct sockaddr *)& ac.serverAddr, sizeof(ac.serverAddr)) < 0) {
+			counters->sendErrors++;
+		}
+	}
+#endif
+	TRACE_END(TRACE_SEND, count);
+}
+
+// Queues the packet in the current slot and moves to the next slot.
+// The queued packets are sent either right now or when the batch
+// is full.
+static void queuePacket_(arvid_client_task* td) {
+	td->batchCount++;
+	td->packetIndex++;
+	if (!(ac.sendFlags & ARVID_SEND_BATCH) || td->packetIndex == PACKET_SLOTS) {
+		sendPackets_(td, td->batchStart, td->batchCount, &td->counters);
+		td->batchStart = td->packetIndex;
+		td->batchCount = 0;
+	}
+	if (td->packetIndex == PACKET_SLOTS) {
+		td->packetIndex = 0;
+		td->batchStart = 0;
+	}
+}
+
+// Sends the rest of the queued packets.
+static void flushPackets_(arvid_client_task* td) {
+	if (td->batchCount > 0) {
+		sendPackets_(td, td->batchStart, td->batchCount, &td->counters);
+		td->batchStart = td->packetIndex;
+		td->batchCount = 0;
+	}
+}
+
+// Builds a parity packet of the last 'count' queued strips in the
+// current slot. The parity data is XOR of the whole strip packets
+// (headers included) padded by zeros to the longest one, so the
+// server can rebuild any single lost strip of the group.
+static void buildParity_(arvid_client_task* td, int count, int posY, int block) {
+	arvid_client_packet* parity = &td->packet[td->packetIndex];
+	unsigned short* dst = &parity->data[PACKET_HEADER_SIZE];
+	int maxSize = 0;
+	int maxWords = 0;
+	int i, j;
+
+#ifdef __linux__
+	waitZeroCopyPacket_(parity);
+#endif
+	for (i = 0; i < count; i++) {
+		arvid_client_packet* packet = &td->packet[(td->packetIndex - count + i + PACKET_SLOTS) % PACKET_SLOTS];
+		int words = (packet->size + 1) >> 1;
+		if (words > maxWords) {
+			memset(dst + maxWords, 0, (words - maxWords) << 1);
+			maxWords = words;
+		}
+		if (packet->size > maxSize) {
+			maxSize = packet->size;
+		}
+		for (j = 0; j < words; j++) {
+			dst[j] ^= packet->data[j];
+		}
+	}
+	parity->strip = -1;
+	parity->frame = ac.frameCount;
+	parity->data[0] = CMD_BLIT_PARITY;
+	parity->data[1] = SET_SHORT(maxSize);
+	parity->data[2] = SET_SHORT(posY);
+	parity->data[3] = SET_SHORT(count);
+	parity->data[4] = SET_SHORT(block);
+	parity->data[5] = SET_SHORT(ac.frameCount);
+	parity->data[6] = 0;
+	parity->data[7] = 0;
+	parity->size = (PACKET_HEADER_SIZE << 1) + maxSize;
+}
+
+// Tells the server the frame is complete, so it can show it at
+// the next vsync as soon as all its strips have arrived. Called by
+// the task finishing the frame as the last one, so it uses its own
+// packet buffer and the frame id instead of the command id.
+// The server does not respond, so the packet is sent several times.
+static void sendFrameCommit_(arvid_client_task* td) {
+	unsigned short packet[4];
+	int i;
+
+	packet[0] = CMD_COMMIT_FRAME;
+	packet[1] = SET_SHORT(ac.frameCount);
+	packet[2] = SET_SHORT(td->frameStrips);
+	packet[3] = 0;
+	for (i = 0; i < PACKET_CNT; i++) {
+		if (sendto(ac.socketFd, PAYLOAD_TYPE packet, sizeof(packet), 0,
+			(struct sockaddr *)& ac.serverAddr, sizeof(ac.serverAddr)) < 0) {
+			td->counters.sendErrors++;
+		}
+	}
+	td->counters.bytesOut += PACKET_CNT * sizeof(packet);
+	td->counters.packetsOut += PACKET_CNT;
+}
+
+// Converts a row of the source pixels starting at the column 'x' of
+// the frame line 'y' to RGB555.
+static void convertRow_(arvid_client_conv* conv, unsigned short* dst, unsigned char* src,
+	int count, int x, int y) {
+	if (conv->dither != NULL) {
+		const unsigned int* bias = conv->ditherPattern[y & 3];
+		unsigned int shifted[4];
+		int i;
+		//keep the pattern aligned to the frame columns
+		if (x & 3) {
+			for (i = 0; i < 4; i++) {
+				shifted[i] = bias[(x + i) & 3];
+			}
+			bias = shifted;
+		}
+		conv->dither(dst, src, count, bias);
+	} else {
+		conv->convert(dst, src, count);
+	}
+}
+
+// Returns the line 'y' of the rotated and flipped source converted to
+// RGB555. The line is built in 'line' unless the source line can be
+// used as it is.
+static unsigned short* sourceLine_(arvid_client_task* td, int y, unsigned short* line) {
+	arvid_client_conv* conv = &td->conv;
+	int pixelSize = conv->pixelSize;
+	unsigned char* raw;
+	int count;
+	int i;
+
+	if (conv->transpose) {
+		int sx = conv->mirrorY ? conv->srcWidth - 1 - y : y;
+		int step = conv->srcStride * pixelSize;
+		unsigned char* src = td->buffer + sx * pixelSize;
+		count = conv->srcHeight;
+		//gather the source column, mirrored by reading it bottom-up
+		if (conv->mirrorX) {
+			src += (count - 1) * step;
+			step = -step;
+		}
+		if (pixelSize == 4) {
+			for (i = 0; i < count; i++) {
+				((unsigned int*) td->gatherBuffer)[i] = *(unsigned int*) (src + i * step);
+			}
+		} else {
+			for (i = 0; i < count; i++) {
+				((unsigned short*) td->gatherBuffer)[i] = *(unsigned short*) (src + i * step);
+			}
+		}
+		raw = td->gatherBuffer;
+	} else {
+		int sy = conv->mirrorY ? conv->srcHeight - 1 - y : y;
+		raw = td->buffer + sy * conv->srcStride * pixelSize;
+		count = conv->srcWidth;
+		if (conv->mirrorX) {
+			if (conv->convert != NULL) {
+				convertRow_(conv, (unsigned short*) td->gatherBuffer, raw, count, 0, y);
+				raw = td->gatherBuffer;
+			}
+			pixconv_reverse(line, (unsigned short*) raw, count);
+			return line;
+		}
+	}
+	if (conv->convert == NULL) {
+		return (unsigned short*) raw;
+	}
+	convertRow_(conv, line, raw, count, 0, y);
+	return line;
+}
+
+// Renders the lines of the rotated and flipped source starting at
+// the line 'posY'. The rotated lines are the source columns, they are
+// transposed in 8x8 tiles from the band of the source columns.
+static void orientLines_(arvid_client_task* td, unsigned short* dst, int dstStride, int posY, int lines) {
+	arvid_client_conv* conv = &td->conv;
+	int i;
+
+	if (conv->transpose) {
+		int first = conv->mirrorY ? conv->srcWidth - posY - lines : posY;
+		const unsigned short* src = (const unsigned short*) td->buffer + first;
+		int srcStride = conv->srcStride;
+		if (conv->convert != NULL) {
+			//convert the band first, it stays in the cache for the transpose
+			for (i = 0; i < conv->srcHeight; i++) {
+				convertRow_(conv, td->orientBuffer + i * lines,
+					td->buffer + (i * conv->srcStride + first) * conv->pixelSize, lines, first, i);
+			}
+			src = td->orientBuffer;
+			srcStride = lines;
+		}
+		if (conv->mirrorX) {
+			src += (conv->srcHeight - 1) * srcStride;
+			srcStride = -srcStride;
+		}
+		if (conv->mirrorY) {
+			dst += (lines - 1) * dstStride;
+			dstStride = -dstStride;
+		}
+		pixconv_transpose(dst, dstStride, src, srcStride, lines, conv->srcHeight);
+		return;
+	}
+	for (i = 0; i < lines; i++, dst += dstStride) {
+		unsigned short* line = sourceLine_(td, posY + i, dst);
+		if (line != dst) {
+			memcpy(dst, line, conv->srcWidth << 1);
+		}
+	}
+}
+
+// Returns the source line converted to RGB555 and scaled horizontally.
+// The last two lines are cached, the neighbouring destination lines
+// mostly need the same source lines.
+static unsigned short* scaledRow_(arvid_client_task* td, int sy) {
+	arvid_client_scale* sc = td->conv.scale;
+	unsigned short* src;
+	int slot;
+
+	for (slot = 0; slot < 2; slot++) {
+		if (td->scaledRowY[slot] == sy) {
+			td->scaledRowNext = slot ^ 1;
+			return td->scaledRow[slot];
+		}
+	}
+	slot = td->scaledRowNext;
+	//the scaler buffer starts with the converted source line
+	src = sourceLine_(td, sy, td->scaleBuffer);
+	pixconv_scale_row(td->scaledRow[slot], src, sc->width, sc->xMap,
+		sc->filter == ARVID_SCALE_BILINEAR ? sc->xWeight : NULL);
+	td->scaledRowY[slot] = sy;
+	td->scaledRowNext = slot ^ 1;
+	return td->scaledRow[slot];
+}
+
+// Renders the scaled destination lines starting at the line 'posY'.
+static void scaleLines_(arvid_client_task* td, unsigned short* dst, int dstStride, int posY, int lines) {
+	arvid_client_scale* sc = td->conv.scale;
+	int i;
+
+	for (i = 0; i < lines; i++, dst += dstStride) {
+		int y = posY + i;
+		int sy = sc->yMap[y];
+		unsigned short* a;
+		if (sy < 0) {
+			memset(dst, 0, sc->width << 1);
+			continue;
+		}
+		a = scaledRow_(td, sy);
+		if (sc->filter == ARVID_SCALE_BILINEAR && sc->yWeight[y] != 0) {
+			unsigned short* b = scaledRow_(td, sy + 1);
+			pixconv_blend_rows(dst, a, b, sc->width, sc->yWeight[y]);
+		} else {
+			memcpy(dst, a, sc->width << 1);
+		}
+	}
+}
+
 // This function can run as a thread loop
 // or can be called directly from the main thread.
 // When run in separate thread it waits for the 
@@ -216,9 +1023,9 @@ static void* threadRunner_(void* data) {
 			printf("arvid client: task %i started! %p\n", td->taskIndex, td);
 		}
 		tsync_thread_set_cpu(td->taskIndex);
+		trace_thread_name(taskName_[td->taskIndex]);
 	}
 	td->started = 100 + td->taskIndex;
-	td->payload[0] = 1; // command blit buffer
 
 	//initialise z stream
 	//raw buffer, level 2 (seems to be the quick enough)
@@ -243,54 +1050,131 @@ static void* threadRunner_(void* data) {
 		
 		//compress the frame buffer
 		{
-			int y;
-			unsigned short* buffer = td->buffer;
+			int y, i;
+			unsigned char* buffer = td->buffer;
+			unsigned short* src;
 			int compressedSize;
+			unsigned long long deflateTime;
 			unsigned char* pix;
 			int posY = td->yPos;
-			int block = 32;
-			int chunkSize = (block << 11); // (block * 1024) * 2
+			int strip = td->stripIndex;
+			int block = STRIP_LINES(td->width);
+			//keep 1 byte for padding to the whole short
+			int chunkSize = ((PACKET_PAYLOAD_SIZE - PACKET_HEADER_SIZE) << 1) - 1;
+			int groupCount = 0;		//strips in the current parity group
+			int groupPosY = posY;
+			TRACE_BEGIN(TRACE_TASK, td->taskIndex);
 			//printf("stride=%i\n", td->stride);
-			//max size of single chunk is 32 Kbytes
-			if (td->stride > 512) {
-				block >>= 1;
-				chunkSize >>= 1;
-			}
+			//packet slots rotate across the frames, so the slot used the
+			//longest time ago is reused first
+			td->batchStart = td->packetIndex;
+			td->batchCount = 0;
 			//send block of 32 or 16 lines at a time
 			for (y = 0; y < td->height; y += block) {
+				arvid_client_packet* packet = &td->packet[td->packetIndex];
+#ifdef __linux__
+				waitZeroCopyPacket_(packet);
+#endif
 				lines = td->height - y;
 				if (lines > block) {
 					lines = block;
 				}
 				
-				pix = (unsigned char*) &td->payload[8];
+				pix = (unsigned char*) &packet->data[PACKET_HEADER_SIZE];
 
-				size = lines * td->stride; 
+				//only the visible width of the lines is sent
+				size = lines * td->width;
 				compressedSize = 0;
+				src = (unsigned short*) buffer;
+				//convert the strip while it is hot in the cache
+				if (td->conv.scale != NULL) {
+					scaleLines_(td, td->convBuffer, td->stride, posY, lines);
+					src = td->convBuffer;
+				} else
+				if (td->conv.orient) {
+					orientLines_(td, td->convBuffer, td->stride, posY, lines);
+					src = td->convBuffer;
+				} else
+				if (td->conv.dither != NULL || (td->conv.convert != NULL && td->width < td->stride)) {
+					for (i = 0; i < lines; i++) {
+						convertRow_(&td->conv, td->convBuffer + i * td->width,
+							buffer + i * td->stride * td->conv.pixelSize, td->width, 0, posY + i);
+					}
+					src = td->convBuffer;
+				} else
+				if (td->conv.convert != NULL) {
+					td->conv.convert(td->convBuffer, buffer, size);
+					src = td->convBuffer;
+				} else
+				if (td->width < td->stride) {
+					//pack the lines without the padding
+					for (i = 0; i < lines; i++) {
+						memcpy(td->convBuffer + i * td->width, buffer + i * td->stride * 2, td->width << 1);
+					}
+					src = td->convBuffer;
+				}
+				if (td->conv.lut != NULL) {
+					pixconv_lut(td->convBuffer, src, size, td->conv.lut);
+					src = td->convBuffer;
+				}
 				//source
-				td->zStream.next_in = (void *) buffer;
+				td->zStream.next_in = (void *) src;
 				td->zStream.avail_in = (size << 1);
 				//destination
 				td->zStream.next_out = (void *)pix;
 				td->zStream.avail_out = chunkSize;
 				
+				TRACE_BEGIN(TRACE_DEFLATE, strip);
+				deflateTime = tsync_get_time_us();
 				ret = deflate(&td->zStream, Z_FINISH);
 				compressedSize = chunkSize - td->zStream.avail_out;
 				deflateReset(&td->zStream);
+				deflateTime = tsync_get_time_us() - deflateTime;
+				TRACE_END(TRACE_DEFLATE, compressedSize);
+				td->counters.rawBytes += size << 1;
+				td->counters.compressedBytes += compressedSize;
+				td->counters.compressTime += deflateTime;
+				histAdd_(td->counters.compressHist, deflateTime);
 				//printf("y: %i deflate: %i stride: %i src_size: %i buf: %p\n", y, compressedSize, td->stride, size << 1, buffer );
-				buffer += size;
-
-				td->payload[1] = SET_SHORT(compressedSize);
-				td->payload[2] = SET_SHORT(posY);
-				td->payload[3] = 0;
-				//send the data
-				sendto(ac.socketFd, PAYLOAD_TYPE td->payload, (8  << 1) + compressedSize, 0,
-					(struct sockaddr *)& ac.serverAddr, sizeof(ac.serverAddr));
-				
-				//ac.statSize += (8 << 1) + compressedSize;
+				buffer += lines * td->stride * td->conv.pixelSize;
+				//clear the padding byte, so the parity is not affected
+				pix[compressedSize] = 0;
+
+				packet->data[0] = CMD_BLIT;
+				packet->data[1] = SET_SHORT(compressedSize);
+				packet->data[2] = SET_SHORT(posY);
+				packet->data[3] = SET_SHORT(strip);
+				packet->data[4] = SET_SHORT(ac.frameCount);
+				packet->data[5] = SET_SHORT(td->frameStrips);
+				packet->data[6] = SET_SHORT(td->width);
+				packet->data[7] = 0;
+				packet->size = (PACKET_HEADER_SIZE << 1) + compressedSize;
+				packet->strip = strip;
+				packet->frame = ac.frameCount;
+				strip++;
+				queuePacket_(td);
+
 				posY += block;
 
+				//protect the group of strips by the parity packet
+				if (ac.fecGroup > 0) {
+					groupCount++;
+					if (groupCount == ac.fecGroup || y + block >= td->height) {
+						buildParity_(td, groupCount, groupPosY, block);
+						queuePacket_(td);
+						groupCount = 0;
+						groupPosY = posY;
+					}
+				}
+
 			} //end for
+			//send the rest of the batch
+			flushPackets_(td);
+			TRACE_END(TRACE_TASK, td->taskIndex);
+		}
+		//the last task to finish commits the frame
+		if (__sync_sub_and_fetch(&ac.tasksRunning, 1) == 0 && ac.frameCommit) {
+			sendFrameCommit_(td);
 		}
 		//signal the job has finished 
 		if (td->taskIndex > 0) {
@@ -301,6 +1185,7 @@ static void* threadRunner_(void* data) {
 	}
 	deflateEnd(&td->zStream);
 	if (td->taskIndex > 0) {
+		trace_thread_exit();
 		if (VERBOSE) {
 			printf("arvid_client: task %i finished\n", td->taskIndex);
 		}
@@ -319,6 +1204,16 @@ static int createTasks_(void) {
 	tsync_thread_set_cpu(0);
 
 	for (i = 0; i < ac.cpuCores; i++) {
+		//forget the packets of the previous connection
+		for (j = 0; j < PACKET_SLOTS; j++) {
+			at[i].packet[j].strip = -1;
+			at[i].packet[j].frame = 0;
+			if (at[i].packet[j].data == NULL) {
+				at[i].packet[j].data = at[i].packet[j].buffer;
+			}
+		}
+		at[i].packetIndex = 0;
+		memset(&at[i].counters, 0, sizeof(arvid_client_counters));
 		//initialise zlib structures
 		at[i].zStream.zalloc = Z_NULL;
 		at[i].zStream.zfree = Z_NULL;
@@ -385,6 +1280,218 @@ static void disposeSockets_(void)  {
 }
 
 
+// Maps the frame buffer shared by the server running on this host.
+static void openShm_(void) {
+#ifdef __linux__
+	int fd;
+	int i;
+	struct stat st;
+	arvid_shm_header* shm;
+	unsigned int seq;
+
+	fd = shm_open(ARVID_SHM_NAME, O_RDWR, 0);
+	if (fd < 0) {
+		return;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(arvid_shm_header)) {
+		close(fd);
+		return;
+	}
+	shm = (arvid_shm_header*) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		return;
+	}
+	if (shm->magic != ARVID_SHM_MAGIC || shm->version != ARVID_SHM_VERSION ||
+		shm->size > st.st_size || shm->bufferOffset +
+		ARVID_SHM_BUFFERS * shm->bufferStride * shm->bufferLines * 2 > shm->size) {
+		printf("arvid_client: invalid shared memory frame buffer\n");
+		munmap(shm, st.st_size);
+		return;
+	}
+	//a segment left behind by a server that is not running
+	seq = shm->vsyncSeq;
+	for (i = 0; i < 10 && shm->vsyncSeq == seq; i++) {
+		sleep_(10);
+	}
+	if (shm->vsyncSeq == seq) {
+		printf("arvid_client: shared memory frame buffer is not active\n");
+		munmap(shm, st.st_size);
+		return;
+	}
+	ac.shm = shm;
+	ac.shmSize = st.st_size;
+	printf("arvid_client: using shared memory frame buffer\n");
+#endif
+}
+
+static void closeShm_(void) {
+#ifdef __linux__
+	if (ac.shm != NULL) {
+		munmap(ac.shm, ac.shmSize);
+		ac.shm = NULL;
+	}
+#endif
+}
+
+// Creates the segment the live metrics are published to, so they
+// can be watched by arvid_stat while the client runs.
+static void openMetrics_(void) {
+#ifdef __linux__
+	char name[64];
+	int fd;
+	arvid_metrics* m;
+
+	sprintf(name, ARVID_METRICS_NAME "%i", (int) getpid());
+	fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return;
+	}
+	if (ftruncate(fd, sizeof(arvid_metrics)) != 0) {
+		close(fd);
+		shm_unlink(name);
+		return;
+	}
+	m = (arvid_metrics*) mmap(NULL, sizeof(arvid_metrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED) {
+		shm_unlink(name);
+		return;
+	}
+	m->version = ARVID_METRICS_VERSION;
+	m->size = sizeof(arvid_metrics);
+	m->pid = (unsigned int) getpid();
+	m->cores = ac.cpuCores;
+	m->time = tsync_get_time_us();
+	__sync_synchronize();
+	m->magic = ARVID_METRICS_MAGIC;
+	ac.metrics = m;
+	ac.metricsTime = m->time;
+#endif
+}
+
+static void closeMetrics_(void) {
+#ifdef __linux__
+	char name[64];
+
+	if (ac.metrics != NULL) {
+		munmap(ac.metrics, sizeof(arvid_metrics));
+		ac.metrics = NULL;
+		sprintf(name, ARVID_METRICS_NAME "%i", (int) getpid());
+		shm_unlink(name);
+	}
+#endif
+}
+
+// Publishes the counters to the live metrics segment. Called by the
+// main thread after each blit, the rates are updated once per second.
+static void publishMetrics_(unsigned int blitTime) {
+	arvid_metrics* m = ac.metrics;
+	unsigned long long now = tsync_get_time_us();
+	arvid_client_counters* c;
+	int i;
+
+	m->seq++;
+	__sync_synchronize();
+	m->time = now;
+	m->width = ac.width;
+	m->height = ac.height;
+	m->frames = ac.frameCount;
+	m->droppedFrames = ac.droppedFrames;
+	m->bytesOut = ac.counters.bytesOut;
+	m->bytesIn = ac.counters.bytesIn + ac.pushCounters.bytesIn;
+	m->packetsOut = ac.counters.packetsOut;
+	m->sendErrors = 0;
+	m->rawBytes = 0;
+	m->compressedBytes = 0;
+	for (i = 0; i < ac.cpuCores; i++) {
+		c = &at[i].counters;
+		m->bytesOut += c->bytesOut;
+		m->packetsOut += c->packetsOut;
+		m->sendErrors += c->sendErrors;
+		m->rawBytes += c->rawBytes;
+		m->compressedBytes += c->compressedBytes;
+		if (i < ARVID_METRICS_CORES) {
+			m->compressTime[i] = c->compressTime;
+		}
+	}
+	if (now - ac.metricsTime >= 1000000) {
+		float seconds = (now - ac.metricsTime) / 1000000.0f;
+		m->fps = (m->frames - ac.metricsFrames) / seconds;
+		m->bytesPerSec = (m->bytesOut - ac.metricsBytes) / seconds;
+		ac.metricsTime = now;
+		ac.metricsFrames = m->frames;
+		ac.metricsBytes = m->bytesOut;
+	}
+	m->blitTime = blitTime;
+	m->vsyncRtt = ac.vsyncRttLast;
+	m->commandRtt = ac.srtt;
+	__sync_synchronize();
+	m->seq++;
+}
+
+// Returns the shared frame buffer the next frame is written to.
+static unsigned short* getShmBackBuffer_(void) {
+	unsigned int index = (ac.shm->commitIndex + 1) % ARVID_SHM_BUFFERS;
+	unsigned short* buffer = (unsigned short*) (((char*) ac.shm) + ac.shm->bufferOffset);
+	return buffer + index * ac.shm->bufferStride * ac.shm->bufferLines;
+}
+
+// Publishes the back buffer as the frame to show at the next vsync.
+static void commitShm_(void) {
+	ac.shm->commitIndex = (ac.shm->commitIndex + 1) % ARVID_SHM_BUFFERS;
+	__sync_fetch_and_add(&ac.shm->commitSeq, 1);
+}
+
+// Maps the frame in the shared frame buffer through the color table.
+static void lutShm_(const unsigned short* lut, int width, int height) {
+	unsigned short* dst = getShmBackBuffer_();
+	int i;
+
+	if (height > ac.shm->bufferLines) {
+		height = ac.shm->bufferLines;
+	}
+	for (i = 0; i < height; i++, dst += ac.shm->bufferStride) {
+		pixconv_lut(dst, dst, width, lut);
+	}
+}
+
+// Copies the frame to the shared frame buffer and commits it.
+static void blitShm_(unsigned char* buffer, int width, int height, int stride,
+	arvid_client_conv* conv) {
+	unsigned short* dst = getShmBackBuffer_();
+	int i;
+
+	//the frame is rendered directly in the shared frame buffer
+	if (buffer != (unsigned char*) dst) {
+		if (width > ac.shm->bufferStride) {
+			width = ac.shm->bufferStride;
+		}
+		if (height > ac.shm->bufferLines) {
+			height = ac.shm->bufferLines;
+		}
+		for (i = 0; i < height; i++) {
+			if (conv->convert != NULL) {
+				convertRow_(conv, dst, buffer, width, 0, i);
+				if (conv->lut != NULL) {
+					pixconv_lut(dst, dst, width, conv->lut);
+				}
+			} else
+			if (conv->lut != NULL) {
+				pixconv_lut(dst, (unsigned short*) buffer, width, conv->lut);
+			} else {
+				memcpy(dst, buffer, width << 1);
+			}
+			dst += ac.shm->bufferStride;
+			buffer += stride * conv->pixelSize;
+		}
+	} else
+	if (conv->lut != NULL) {
+		lutShm_(conv->lut, width, height);
+	}
+	commitShm_();
+}
+
 int arvid_client_connect(char* serverAddress) {
 
 	memset(&ac, 0, sizeof(ac));
@@ -393,6 +1500,9 @@ int arvid_client_connect(char* serverAddress) {
 	if (ac.cpuCores < 1 || ac.cpuCores > MAX_TASK) {
 		ac.cpuCores = MAX_TASK;
 	}
+	if (cpuCoresLimit > 0) {
+		ac.cpuCores = cpuCoresLimit;
+	}
 	
 	printf("arvid_client: ver. " ARVID_CLIENT_VERSION " - multithreaded (cores: %i)\n", ac.cpuCores);
 	//prepare task data and start threads;
@@ -409,26 +1519,41 @@ int arvid_client_connect(char* serverAddress) {
 	ac.serverAddr.sin_family = AF_INET;
 	ac.serverAddr.sin_addr.s_addr = inet_addr(serverAddress);
 	ac.serverAddr.sin_port = htons(32100);
-	ac.statSize = 0;
 	ac.width = 0;
 	ac.height = 0;
 	ac.blitWait = 0;
 	ac.blitType = ARVID_BLIT_TYPE_BLOCKING;
+	ac.sendFlags = 0;
+	ac.fecGroup = 0;
+	ac.nack = 0;
+	ac.videoMode = -1;
+	ac.refreshRate = 60.0f;
+	ac.pacingRate = -1;
+	ac.cmdTimeout = CMD_TIMEOUT;
+	ac.vsyncMode = ARVID_VSYNC_SERVER;
+	ac.rto = CMD_RTO_INIT;
 
 	if (ac.socketFd >= 0) {
 		int result = -101;
 		ac.payload[0] = CMD_INIT;
 		sendCommand_(1);
-		//wait a bit (1 sec) to ensure the response got back
-		sleep_(1000);
-		result = receiveResultNonBlocking_();
-		if (result < 0) {
+		result = receiveResult_(RESPONSE_SIZE);
+		if (result == ARVID_CLIENT_ERROR_TIMEOUT) {
 			printf("arvid_client: connection failed!\n");
+			close(ac.socketFd);
 			disposeSockets_();
-		} else {
-		    ac.opened = 1;
+			return result;
 		}
-		return result;
+		ac.opened = 1;
+		//the server runs on this host: try to bypass the network
+		if ((ntohl(ac.serverAddr.sin_addr.s_addr) >> 24) == 127) {
+			openShm_();
+		}
+		if (metricsEnabled > 0 || (metricsEnabled < 0 && getenv("ARVID_METRICS") != NULL &&
+			atoi(getenv("ARVID_METRICS")) > 0)) {
+			openMetrics_();
+		}
+		return 0;
 	} else {
 		printf("arvid_client: failed to create socket. ret=%i\n", ac.socketFd);
 	}
@@ -439,54 +1564,383 @@ int arvid_client_connect(char* serverAddress) {
 
 
 
-//send the buffer to arvid hidden frame-buffer
-int arvid_client_blit_buffer(unsigned short* buffer, int width, int height,  int stride) {
-	int i;
-	int yPos;
-	int taskCount;
-	int linesPerTask;
-	int taskStart;
-	int taskEnd;
-	
-	if (!ac.opened) {
-	    return -1;
+// Appends the frame to the capture file.
+static void captureFrame_(unsigned char* buffer, int width, int height, int stride,
+	arvid_client_conv* conv) {
+	arvid_capture_frame frame;
+	unsigned long long padding = 0;
+	unsigned short row[512];
+	int i, x;
+
+	frame.size = ((width * height * 2) + 7) & ~7;
+	frame.width = width;
+	frame.height = height;
+	frame.stride = stride;
+	frame.reserved = 0;
+	frame.index = ac.captureFrames++;
+	frame.time = tsync_get_time_us() - ac.captureStart;
+	fwrite(&frame, sizeof(frame), 1, ac.captureFile);
+	for (i = 0; i < height; i++) {
+		if (conv->convert == NULL) {
+			fwrite(buffer, 2, width, ac.captureFile);
+		} else {
+			//the capture is always RGB555
+			for (x = 0; x < width; x += 512) {
+				int count = width - x < 512 ? width - x : 512;
+				convertRow_(conv, row, buffer + x * conv->pixelSize, count, x, i);
+				fwrite(row, 2, count, ac.captureFile);
+			}
+		}
+		buffer += stride * conv->pixelSize;
 	}
-	
-	taskCount = ac.cpuCores;
-	taskStart = 0;
-	taskEnd = taskCount;
+	fwrite(&padding, 1, frame.size - width * height * 2, ac.captureFile);
+}
 
-	if (ac.blitType == ARVID_BLIT_TYPE_NON_BLOCKING) {
-		taskStart = 1;
-		taskCount -= 1;  
+// Makes sure the task can hold a converted strip of the given width.
+static int allocConvBuffer_(arvid_client_task* td, int width) {
+	int size = STRIP_LINES(width) * width;
+	if (td->convSize >= size) {
+		return 0;
 	}
-	linesPerTask = ((height / taskCount) >> 2) << 2; //multiplies of 4 lines
-	
-	if (taskCount < 2)  {
-		linesPerTask = height;
-	} else
-	if (linesPerTask * taskCount < height) {
-		linesPerTask += 4;
+	free(td->convBuffer);
+	td->convBuffer = (unsigned short*) malloc(size << 1);
+	td->convSize = td->convBuffer != NULL ? size : 0;
+	return td->convBuffer != NULL ? 0 : -1;
+}
+
+// Makes sure the task can hold the scaler lines.
+static int allocScaleBuffer_(arvid_client_task* td, int srcWidth, int width) {
+	//converted source line followed by 2 cached lines
+	int size = srcWidth + 2 * width;
+	if (td->scaleSize < size) {
+		free(td->scaleBuffer);
+		td->scaleBuffer = (unsigned short*) malloc(size << 1);
+		td->scaleSize = td->scaleBuffer != NULL ? size : 0;
+		if (td->scaleBuffer == NULL) {
+			return -1;
+		}
+	}
+	td->scaledRow[0] = td->scaleBuffer + srcWidth;
+	td->scaledRow[1] = td->scaledRow[0] + width;
+	//the source frame has changed
+	td->scaledRowY[0] = -1;
+	td->scaledRowY[1] = -1;
+	td->scaledRowNext = 0;
+	return 0;
+}
+
+// Makes sure the task can hold the band of the source columns
+// ('band' pixels) and a single source line ('line' pixels).
+static int allocOrientBuffer_(arvid_client_task* td, int band, int line) {
+	int size = band * 2 + line * 4;
+	if (td->orientSize < size) {
+		free(td->orientBuffer);
+		td->orientBuffer = (unsigned short*) malloc(size);
+		td->orientSize = td->orientBuffer != NULL ? size : 0;
+		if (td->orientBuffer == NULL) {
+			return -1;
+		}
+	}
+	td->gatherBuffer = (unsigned char*) (td->orientBuffer + band);
+	return 0;
+}
+
+// Computes the source position of each destination pixel along one axis.
+static void scaleAxis_(int* map, unsigned short* weight, int src, int dst, int filter) {
+	int i;
+
+	if (filter == ARVID_SCALE_INTEGER) {
+		//the largest integer ratio that fits, centered
+		int up = dst / src;
+		int down = (src + dst - 1) / dst;
+		int size = up >= 1 ? src * up : src / down;
+		int offset = (dst - size) / 2;
+		for (i = 0; i < dst; i++) {
+			int p = i - offset;
+			if (p < 0 || p >= size) {
+				map[i] = -1;
+			} else {
+				map[i] = up >= 1 ? p / up : p * down;
+			}
+			weight[i] = 0;
+		}
+		return;
+	}
+	for (i = 0; i < dst; i++) {
+		//sample at the pixel centers
+		if (filter == ARVID_SCALE_BILINEAR) {
+			int pos = (int) ((2LL * i + 1) * src * 256 / (2 * dst)) - 128;
+			if (pos < 0) {
+				pos = 0;
+			}
+			map[i] = pos >> 8;
+			weight[i] = pos & 255;
+			if (map[i] >= src - 1) {
+				map[i] = src - 1;
+				weight[i] = 0;
+			}
+		} else {
+			map[i] = (int) ((2LL * i + 1) * src / (2 * dst));
+			weight[i] = 0;
+		}
+	}
+}
+
+// Prepares the scaler tables, they are kept till the sizes or
+// the filter change.
+static int updateScale_(int srcWidth, int srcHeight, int width, int height, int filter) {
+	arvid_client_scale* sc = &ac.scale;
+
+	if (sc->xMap != NULL && sc->srcWidth == srcWidth && sc->srcHeight == srcHeight &&
+		sc->width == width && sc->height == height && sc->filter == filter) {
+		return 0;
+	}
+	free(sc->xMap);
+	//all the tables in a single block
+	sc->xMap = (int*) malloc((width + height) * (sizeof(int) + sizeof(unsigned short)));
+	if (sc->xMap == NULL) {
+		return -1;
+	}
+	sc->yMap = sc->xMap + width;
+	sc->xWeight = (unsigned short*) (sc->yMap + height);
+	sc->yWeight = sc->xWeight + width;
+	sc->srcWidth = srcWidth;
+	sc->srcHeight = srcHeight;
+	sc->width = width;
+	sc->height = height;
+	sc->filter = filter;
+	scaleAxis_(sc->xMap, sc->xWeight, srcWidth, width, filter);
+	scaleAxis_(sc->yMap, sc->yWeight, srcHeight, height, filter);
+	return 0;
+}
+
+// Sends the frame to the hidden frame buffer. The frame is scaled to
+// the video mode size by the filter ARVID_SCALE_xxx, -1 - not scaled.
+static int blitFrame_(void* data, int width, int height, int stride, int format, int filter);
+
+//send the buffer to arvid hidden frame-buffer
+int arvid_client_blit_buffer(unsigned short* buffer, int width, int height,  int stride) {
+	return blitFrame_(buffer, width, height, stride, ARVID_FORMAT_RGB555, -1);
+}
+
+int arvid_client_blit_buffer_fmt(void* data, int width, int height, int stride, int format) {
+	return blitFrame_(data, width, height, stride, format, -1);
+}
+
+int arvid_client_blit_scaled(void* data, int width, int height, int stride, int format, int filter) {
+	if (filter < ARVID_SCALE_NEAREST || filter > ARVID_SCALE_BILINEAR) {
+		return -2;
 	}
+	return blitFrame_(data, width, height, stride, format, filter);
+}
+
+static int blitFrame_(void* data, int width, int height, int stride, int format, int filter) {
+	int i;
+	int yPos;
+	int taskCount;
+	int linesPerTask;
+	int taskStart;
+	int taskEnd;
+	int frameStrips;
+	unsigned long long blitTime;
+	unsigned char* buffer = (unsigned char*) data;
+	arvid_client_conv conv;
 	
+	if (!ac.opened) {
+	    return -1;
+	}
+	conv.pixelSize = pixconv_pixel_size(format);
+	if (conv.pixelSize == 0) {
+		printf("arvid_client: unknown pixel format %i\n", format);
+		return -2;
+	}
+	conv.convert = pixconv_get(format);
+	conv.dither = ac.ditherMode != ARVID_DITHER_NONE ? pixconv_get_dither(format) : NULL;
+	if (conv.dither != NULL) {
+		//the temporal dither moves the pattern every frame
+		pixconv_dither_pattern(conv.ditherPattern,
+			ac.ditherMode == ARVID_DITHER_TEMPORAL ? (ac.frameCount + 1) & 15 : 0);
+	}
+	conv.scale = NULL;
+	conv.lut = ac.lut;
+	ac.lutSent = ac.lut;
+	conv.srcWidth = width;
+	conv.srcHeight = height;
+	conv.srcStride = stride;
+	conv.orient = ac.rotation != 0;
+	//rotation as the transpose followed by the mirroring
+	conv.transpose = (ac.rotation & 1) != 0;
+	conv.mirrorX = (ac.rotation & 3) == ARVID_ROTATE_90 || (ac.rotation & 3) == ARVID_ROTATE_180;
+	conv.mirrorY = (ac.rotation & 3) == ARVID_ROTATE_180 || (ac.rotation & 3) == ARVID_ROTATE_270;
+	conv.mirrorX ^= (ac.rotation & ARVID_FLIP_H) != 0;
+	conv.mirrorY ^= (ac.rotation & ARVID_FLIP_V) != 0;
+	blitTime = tsync_get_time_us();
+
+	TRACE_BEGIN(TRACE_BLIT, ac.frameCount + 1);
+
+	//the tasks render the rotated frame from the source
+	if (conv.transpose) {
+		width = conv.srcHeight;
+		height = conv.srcWidth;
+	}
+	if (conv.orient) {
+		stride = width;
+	}
+	//the tasks render the frame of the video mode size from the source
+	if (filter >= 0) {
+		int modeWidth = arvid_client_get_width();
+		int modeHeight = arvid_client_get_height();
+		if (width <= 0 || height <= 0 || modeWidth <= 0 || modeHeight <= 0) {
+			TRACE_END(TRACE_BLIT, ac.frameCount);
+			return -2;
+		}
+		if (updateScale_(width, height, modeWidth, modeHeight, filter) != 0) {
+			printf("arvid_client: failed to allocate scaler\n");
+			TRACE_END(TRACE_BLIT, ac.frameCount);
+			return -3;
+		}
+		conv.scale = &ac.scale;
+		width = modeWidth;
+		height = modeHeight;
+		stride = modeWidth;
+	}
+
+	if (ac.shm != NULL && (conv.scale != NULL || conv.orient)) {
+		int lines = height < ac.shm->bufferLines ? height : ac.shm->bufferLines;
+		int band = conv.scale == NULL && conv.transpose ? conv.srcHeight * SHM_ORIENT_LINES : 0;
+		if (width > ac.shm->bufferStride) {
+			TRACE_END(TRACE_BLIT, ac.frameCount);
+			return -2;
+		}
+		if ((conv.scale != NULL && allocScaleBuffer_(&at[0], conv.scale->srcWidth, width) != 0) ||
+			(conv.orient && allocOrientBuffer_(&at[0], band,
+				conv.srcWidth > conv.srcHeight ? conv.srcWidth : conv.srcHeight) != 0)) {
+			TRACE_END(TRACE_BLIT, ac.frameCount);
+			return -3;
+		}
+		//the capture records the source of the frames actually sent
+		if (ac.captureFile != NULL) {
+			captureFrame_(buffer, conv.srcWidth, conv.srcHeight, conv.srcStride, &conv);
+		}
+		ac.frameCount++;
+		at[0].buffer = buffer;
+		at[0].conv = conv;
+		if (conv.scale != NULL) {
+			scaleLines_(&at[0], getShmBackBuffer_(), ac.shm->bufferStride, 0, lines);
+		} else {
+			//render the rotated frame in bands that fit the cache
+			unsigned short* dst = getShmBackBuffer_();
+			for (i = 0; i < lines; i += SHM_ORIENT_LINES) {
+				orientLines_(&at[0], dst + i * ac.shm->bufferStride, ac.shm->bufferStride, i,
+					lines - i < SHM_ORIENT_LINES ? lines - i : SHM_ORIENT_LINES);
+			}
+		}
+		if (conv.lut != NULL) {
+			lutShm_(conv.lut, width, lines);
+		}
+		commitShm_();
+	} else
+	if (ac.shm != NULL) {
+		if (ac.captureFile != NULL) {
+			captureFrame_(buffer, conv.srcWidth, conv.srcHeight, conv.srcStride, &conv);
+		}
+		ac.frameCount++;
+		blitShm_(buffer, width, height, stride, &conv);
+	}
+	if (ac.shm != NULL) {
+		blitTime = tsync_get_time_us() - blitTime;
+		histAdd_(ac.blitHist, blitTime);
+		if (ac.metrics != NULL) {
+			publishMetrics_((unsigned int) blitTime);
+		}
+		TRACE_END(TRACE_BLIT, ac.frameCount);
+		return 0;
+	}
+	
+	//frame boundary: update the transmit pacing
+	ac.pacingDelayLast = __sync_lock_test_and_set(&ac.pacingDelay, 0);
+	ac.frameBytesLast = __sync_lock_test_and_set(&ac.frameBytes, 0);
+	if (ac.pacingRate > 0) {
+		ac.pacingRateFrame = ac.pacingRate;
+	} else
+	if (ac.pacingRate == 0) {
+		//spread the packets over the part of the frame period
+		//(expecting similar size as the last frame)
+		ac.pacingRateFrame = (int) (ac.frameBytesLast * ac.refreshRate * 100 / ac.pacingPercent);
+	} else {
+		ac.pacingRateFrame = 0;
+	}
+	if (VERBOSE && ac.pacingRateFrame > 0) {
+		printf("arvid_client: pacing rate=%i delay=%u usec\n", ac.pacingRateFrame, ac.pacingDelayLast);
+	}
+
+	taskCount = ac.cpuCores;
+	taskStart = 0;
+	taskEnd = taskCount;
+
+	if (ac.blitType == ARVID_BLIT_TYPE_NON_BLOCKING) {
+		taskStart = 1;
+		taskCount -= 1;  
+	}
+	linesPerTask = ((height / taskCount) >> 2) << 2; //multiplies of 4 lines
+	
+	if (taskCount < 2)  {
+		linesPerTask = height;
+	} else
+	if (linesPerTask * taskCount < height) {
+		linesPerTask += 4;
+	}
+	if (conv.convert != NULL || conv.scale != NULL || conv.orient || conv.lut != NULL || width < stride) {
+		//the band of the source columns is transposed per strip
+		int band = conv.scale == NULL && conv.transpose ? conv.srcHeight * STRIP_LINES(width) : 0;
+		for (i = taskStart; i < taskEnd; i++) {
+			if (allocConvBuffer_(&at[i], width) != 0 || (conv.scale != NULL &&
+				allocScaleBuffer_(&at[i], conv.scale->srcWidth, width) != 0) || (conv.orient &&
+				allocOrientBuffer_(&at[i], band, conv.srcWidth > conv.srcHeight ? conv.srcWidth : conv.srcHeight) != 0)) {
+				printf("arvid_client: failed to allocate conversion buffer\n");
+				TRACE_END(TRACE_BLIT, ac.frameCount);
+				return -3;
+			}
+		}
+	}
+	if (ac.captureFile != NULL) {
+		captureFrame_(buffer, conv.srcWidth, conv.srcHeight, conv.srcStride, &conv);
+	}
+	
+	ac.frameCount++;
+	ac.tasksRunning = taskEnd - taskStart;
+	frameStrips = 0;
 	yPos = 0;
 	//distribute task data
 	for (i = taskStart; i < taskEnd; i++) {
 		int lines = height - yPos;
+		int block = STRIP_LINES(width);
 		if (lines > linesPerTask) {
 			lines = linesPerTask;
 		}
 		at[i].buffer = buffer;
+		at[i].conv = conv;
 		at[i].yPos = yPos;
+		at[i].stripIndex = frameStrips;
+		frameStrips += (lines + block - 1) / block;
 		at[i].height = lines;
 		at[i].width = width;
 		at[i].stride = stride;
 		
 		yPos += lines;
 		//each task will get different portion of the screen buffer
-		//assigned to compress and to transfer
-		buffer += (lines * stride);
-
+		//assigned to compress and to transfer (the scaler picks the
+		//source lines of its portion from the whole source)
+		if (conv.scale == NULL && !conv.orient) {
+			buffer += lines * stride * conv.pixelSize;
+		}
+	}
+	//the tasks send the strip count of the frame, so it must be
+	//complete before any of them starts
+	ac.frameStrips = frameStrips;
+	__sync_synchronize();
+	for (i = taskStart; i < taskEnd; i++) {
+		at[i].frameStrips = frameStrips;
 		//signal start of the task (the task should be waiting locked on its start mutex)
 		if (i > 0) {
 			tsync_mutex_signal(&at[i].mutexStart);
@@ -503,60 +1957,505 @@ int arvid_client_blit_buffer(unsigned short* buffer, int width, int height,  int
 		threadRunner_(&at[0]);
 	
 		//now wait till all remaining tasks have finished
+		TRACE_BEGIN(TRACE_WAIT_TASKS, taskCount);
 		for (i = 1; i < taskCount; i++) {
 			tsync_mutex_wait(&at[i].mutexEnd);
 		}
+		TRACE_END(TRACE_WAIT_TASKS, taskCount);
 	}
-	
+	blitTime = tsync_get_time_us() - blitTime;
+	histAdd_(ac.blitHist, blitTime);
+	if (ac.metrics != NULL) {
+		publishMetrics_((unsigned int) blitTime);
+	}
+	TRACE_END(TRACE_BLIT, ac.frameCount);
 	
 	return 0;
 }
 
+unsigned short* arvid_client_get_frame_buffer(int* stride) {
+	if (!ac.opened || ac.shm == NULL) {
+		return NULL;
+	}
+	if (stride != NULL) {
+		*stride = ac.shm->bufferStride;
+	}
+	return getShmBackBuffer_();
+}
+
 unsigned int arvid_client_get_stat_transferred_size(void) {
-	unsigned int result = ac.statSize;
-	ac.statSize = 0;
+	unsigned long long size = 0;
+	unsigned int result;
+	int i;
+
+	for (i = 0; i < ac.cpuCores; i++) {
+		size += at[i].counters.bytesOut;
+	}
+	result = (unsigned int) (size - ac.statSizeLast);
+	ac.statSizeLast = size;
 	return result;
 }
 
+// Adds the counter set to the statistics.
+static void addCounters_(arvid_client_stats* stats, arvid_client_counters* c) {
+	int i;
+	stats->bytesOut += c->bytesOut;
+	stats->bytesIn += c->bytesIn;
+	stats->packetsOut += c->packetsOut;
+	stats->packetsIn += c->packetsIn;
+	stats->rawBytes += c->rawBytes;
+	stats->compressedBytes += c->compressedBytes;
+	stats->compressTime += c->compressTime;
+	stats->sendErrors += c->sendErrors;
+	for (i = 0; i < ARVID_STAT_HISTOGRAM_SIZE; i++) {
+		stats->compressHist[i] += c->compressHist[i];
+	}
+}
+
+// Sums up the counters of all the threads collected since the connect.
+static void collectStats_(arvid_client_stats* stats) {
+	int i;
+
+	memset(stats, 0, sizeof(arvid_client_stats));
+	addCounters_(stats, &ac.counters);
+	addCounters_(stats, &ac.pushCounters);
+	for (i = 0; i < ac.cpuCores; i++) {
+		addCounters_(stats, &at[i].counters);
+	}
+	stats->framesBlitted = ac.frameCount;
+	stats->droppedFrames = ac.droppedFrames;
+	stats->commandResends = ac.commandResends;
+	stats->commandTimeouts = ac.commandTimeouts;
+	for (i = 0; i < ARVID_STAT_HISTOGRAM_SIZE; i++) {
+		stats->blitHist[i] = ac.blitHist[i];
+		stats->vsyncRttHist[i] = ac.vsyncRttHist[i];
+	}
+}
+
+int arvid_client_get_stats(arvid_client_stats* stats) {
+	arvid_client_stats* base = &ac.statBase;
+	int i;
+
+	if (!ac.opened) {
+		return -1;
+	}
+	if (stats == NULL) {
+		return -2;
+	}
+	collectStats_(stats);
+	stats->framesBlitted -= base->framesBlitted;
+	stats->droppedFrames -= base->droppedFrames;
+	stats->bytesOut -= base->bytesOut;
+	stats->bytesIn -= base->bytesIn;
+	stats->packetsOut -= base->packetsOut;
+	stats->packetsIn -= base->packetsIn;
+	stats->rawBytes -= base->rawBytes;
+	stats->compressedBytes -= base->compressedBytes;
+	stats->compressTime -= base->compressTime;
+	stats->sendErrors -= base->sendErrors;
+	stats->commandResends -= base->commandResends;
+	stats->commandTimeouts -= base->commandTimeouts;
+	for (i = 0; i < ARVID_STAT_HISTOGRAM_SIZE; i++) {
+		stats->compressHist[i] -= base->compressHist[i];
+		stats->blitHist[i] -= base->blitHist[i];
+		stats->vsyncRttHist[i] -= base->vsyncRttHist[i];
+	}
+	stats->compressionRatio = stats->compressedBytes > 0 ?
+		(float) stats->rawBytes / stats->compressedBytes : 0.0f;
+	stats->vsyncRttLast = ac.vsyncRttLast;
+	stats->vsyncRttMin = ac.vsyncRttMin;
+	stats->vsyncRttMax = ac.vsyncRttMax;
+	return 0;
+}
+
+int arvid_client_reset_stats(void) {
+	if (!ac.opened) {
+		return -1;
+	}
+	//the tasks keep counting, so only remember where to start from
+	collectStats_(&ac.statBase);
+	ac.vsyncRttMin = 0;
+	ac.vsyncRttMax = 0;
+	return 0;
+}
+
 unsigned int arvid_client_get_frame_number(void) {
+	int result;
 	if (!ac.opened) {
 	    return 0;
 	}
+	if (ac.shm != NULL) {
+		return ac.shm->frameNumber;
+	}
 
 	ac.payload[0] = CMD_FRAME_NUMBER; //get frame number
 	sendCommand_(1);
-	return (unsigned int) receiveResult_(RESPONSE_SIZE);
+	result = receiveResult_(RESPONSE_SIZE);
+	if (result == ARVID_CLIENT_ERROR_TIMEOUT) {
+		return 0;
+	}
+	return (unsigned int) result;
+}
+
+// Resends the strips of the last frame reported missing by the server.
+static void resendStrips_(unsigned int missing) {
+	int i, j;
+	for (i = 0; i < ac.cpuCores; i++) {
+		for (j = 0; j < PACKET_SLOTS; j++) {
+			arvid_client_packet* packet = &at[i].packet[j];
+			if (packet->frame == ac.frameCount && packet->strip >= 0 &&
+				packet->strip < NACK_MAX_STRIPS && (missing & (1u << packet->strip))) {
+				//the main thread counts the resent packets
+				sendPackets_(&at[i], j, 1, &ac.counters);
+			}
+		}
+	}
+}
+
+// Sets the nominal frame period of the local vsync model to the refresh
+// rate and forgets the model state.
+static void setVsyncModel_(float rate) {
+	if (rate <= 0) {
+		rate = 60.0f;
+	}
+	ac.vsyncModelStale = 0;
+	ac.refreshRate = rate;
+	ac.vsyncNominal = 1000000.0 / rate;
+	ac.vsyncPeriod = ac.vsyncNominal;
+	ac.vsyncSamples = 0;
+	ac.vsyncLocalFrames = 0;
+}
+
+// Resets the local vsync model to the refresh rate read from the server.
+static void resetVsyncModel_(void) {
+	float rate = 60.0f;
+	if (ac.videoMode >= 0) {
+		rate = arvid_client_get_video_mode_refresh_rate(ac.videoMode, ac.videoLines);
+	}
+	setVsyncModel_(rate);
+}
+
+// Corrects the local vsync model by the server vsync response.
+// The vsync time is estimated as the response arrival time minus half
+// of the round trip. Network delays can only make the response late,
+// so early responses correct the phase faster than late ones.
+static void updateVsyncModel_(unsigned int frame) {
+	unsigned long long time = ac.recvTime - ac.srtt / 2;
+	unsigned int frames = frame - ac.vsyncFrame;
+	double predicted;
+	double error;
+
+	//(re)start the model on the first vsync or after a long pause
+	if (ac.vsyncSamples == 0 || frames == 0 || frames > 1000) {
+		ac.vsyncFrame = frame;
+		ac.vsyncTime = time;
+		ac.vsyncSamples = 1;
+		return;
+	}
+	predicted = ac.vsyncTime + frames * ac.vsyncPeriod;
+	error = (double) time - predicted;
+
+	//frequency correction (kept within 2% of the video mode refresh rate)
+	ac.vsyncPeriod += error / frames * 0.1;
+	if (ac.vsyncPeriod > ac.vsyncNominal * 1.02) {
+		ac.vsyncPeriod = ac.vsyncNominal * 1.02;
+	} else
+	if (ac.vsyncPeriod < ac.vsyncNominal * 0.98) {
+		ac.vsyncPeriod = ac.vsyncNominal * 0.98;
+	}
+	//phase correction
+	ac.vsyncTime = (unsigned long long) (predicted + error * (error < 0 ? 0.5 : 0.125));
+	ac.vsyncFrame = frame;
+	ac.vsyncSamples++;
+}
+
+// Sleeps till the next vsync predicted by the local model.
+// Returns the predicted frame number.
+static unsigned int waitLocalVsync_(void) {
+	unsigned long long now = tsync_get_time_us();
+	unsigned int frame = ac.vsyncFrame + 1;
+	unsigned long long target;
+
+	if (now > ac.vsyncTime) {
+		frame += (unsigned int) ((now - ac.vsyncTime) / ac.vsyncPeriod);
+	}
+	//always wait for a new vsync
+	if ((int) (frame - ac.vsyncLastFrame) <= 0) {
+		frame = ac.vsyncLastFrame + 1;
+	}
+	target = ac.vsyncTime + (unsigned long long) ((frame - ac.vsyncFrame) * ac.vsyncPeriod) + VSYNC_LOCAL_MARGIN;
+	if (target > now) {
+		tsync_sleep_us((unsigned int) (target - now));
+	}
+	return frame;
+}
+
+static unsigned int waitServerVsync_(void) {
+	int result;
+
+	TRACE_BEGIN(TRACE_VSYNC_REQUEST, ac.frameCount);
+	ac.payload[0] = CMD_VSYNC; //wait for vsync
+	if (ac.nack) {
+		//let the server know which frame and how many strips to expect
+		ac.payload[2] = SET_SHORT(ac.frameStrips);
+		ac.payload[3] = SET_SHORT(ac.frameCount);
+		sendCommand_(3);
+		result = receiveResultWait_(VSYNC_NACK_RESPONSE_SIZE, CMD_VSYNC_WAIT);
+	} else {
+		sendCommand_(1);
+		result = receiveResultWait_(VSYNC_RESPONSE_SIZE, CMD_VSYNC_WAIT);
+	}
+	TRACE_END(TRACE_VSYNC_REQUEST, result);
+	if (result == ARVID_CLIENT_ERROR_TIMEOUT) {
+		return 0;
+	}
+	if (!ac.cmdResent) {
+		unsigned int rtt = (unsigned int) (ac.recvTime - ac.cmdTime);
+		ac.vsyncRttLast = rtt;
+		if (ac.vsyncRttMin == 0 || rtt < ac.vsyncRttMin) {
+			ac.vsyncRttMin = rtt;
+		}
+		if (rtt > ac.vsyncRttMax) {
+			ac.vsyncRttMax = rtt;
+		}
+		histAdd_(ac.vsyncRttHist, rtt);
+	}
+
+	//store button status
+	{
+		unsigned char* data = (unsigned char*) ac.recv;
+		data += 6; //button status at index 6
+		ac.buttons = GET_INT(data);
+	}
+
+	//resend the missing strips (bitmap at index 10)
+	if (ac.nack && ac.recvSize >= VSYNC_NACK_RESPONSE_SIZE) {
+		unsigned char* data = (unsigned char*) ac.recv;
+		unsigned int missing;
+		data += 10;
+		missing = (unsigned int) GET_INT(data);
+		if (missing != 0) {
+			resendStrips_(missing);
+		}
+	}
+	return (unsigned int) result; 
+}
+
+// Receives the vsync notifications pushed by the server and keeps
+// the latest frame number and button status.
+static void* pushRunner_(void* data) {
+	unsigned char buf[32];
+	struct sockaddr_in addr;
+#ifdef MINGW
+	int addrSize;
+#else
+	socklen_t addrSize;
+#endif
+
+	while (!ac.pushStop) {
+		int size;
+		addrSize = sizeof(addr);
+		size = recvfrom(ac.pushFd, buf, sizeof(buf), 0, (struct sockaddr *)& addr, &addrSize);
+		if (ac.pushStop) {
+			break;
+		}
+		if (size < 0) {
+			sleep_(10);
+			continue;
+		}
+		//accept the notifications of the server only
+		if (addr.sin_addr.s_addr != ac.serverAddr.sin_addr.s_addr ||
+			addr.sin_port != ac.serverAddr.sin_port) {
+			continue;
+		}
+		ac.pushCounters.bytesIn += size;
+		ac.pushCounters.packetsIn++;
+		if (size >= VSYNC_PUSH_SIZE && GET_SHORT(buf) == CMD_VSYNC_PUSH) {
+			unsigned char* d = buf + 2;
+			unsigned int frame = (unsigned int) GET_INT(d);
+			d += 4;
+			ac.buttons = GET_INT(d);
+			ac.pushFrame = frame;
+			tsync_mutex_signal(&ac.pushSignal);
+		}
+	}
+	ac.pushRunning = 0;
+	return NULL;
+}
+
+// Stops the vsync notification receiver and releases its resources.
+static void stopPushRunner_(void) {
+	struct sockaddr_in addr;
+	char wake = 0;
+	int i;
+
+	ac.pushStop = 1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	addr.sin_port = htons(ac.pushPort);
+	//wake up the receiver blocked in recvfrom until the thread ends,
+	//the socket and the mutex must not be released before that
+	for (i = 0; ac.pushRunning && i < PUSH_STOP_WAIT / 10; i++) {
+		sendto(ac.pushFd, PAYLOAD_TYPE &wake, 1, 0, (struct sockaddr *)& addr, sizeof(addr));
+		sleep_(10);
+	}
+	if (ac.pushRunning) {
+		//leave the socket and the mutex to the stuck thread
+		printf("arvid_client: vsync receiver did not stop\n");
+		ac.pushFd = -1;
+		return;
+	}
+	close(ac.pushFd);
+	ac.pushFd = -1;
+	tsync_mutex_close(&ac.pushSignal);
+}
+
+// Subscribes to (or unsubscribes from) the vsync notifications.
+// The server pushes the notifications to the port of the push socket.
+static int subscribeVsync_(int enable) {
+	int result;
+
+	if (enable) {
+		struct sockaddr_in addr;
+#ifdef MINGW
+		int addrSize = sizeof(addr);
+#else
+		socklen_t addrSize = sizeof(addr);
+#endif
+		ac.pushFd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (ac.pushFd < 0) {
+			return -3;
+		}
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = 0;
+		if (bind(ac.pushFd, (struct sockaddr *)& addr, sizeof(addr)) != 0 ||
+			getsockname(ac.pushFd, (struct sockaddr *)& addr, &addrSize) != 0 ||
+			tsync_mutex_open(&ac.pushSignal) != 0) {
+			close(ac.pushFd);
+			ac.pushFd = -1;
+			return -3;
+		}
+		ac.pushPort = ntohs(addr.sin_port);
+		ac.pushStop = 0;
+		ac.pushFrame = 0;
+		ac.pushRunning = 1;
+		if (tsync_thread_start(&ac.pushThread, pushRunner_, NULL) != 0) {
+			ac.pushRunning = 0;
+			close(ac.pushFd);
+			ac.pushFd = -1;
+			tsync_mutex_close(&ac.pushSignal);
+			return -3;
+		}
+	}
+
+	ac.payload[0] = CMD_SUBSCRIBE_VSYNC;
+	//payload[1] is reserverd (contains packet id)
+	ac.payload[2] = enable ? SET_SHORT(ac.pushPort) : 0;
+	sendCommand_(2);
+	result = receiveResult_(RESPONSE_SIZE);
+
+	if (!enable || result < 0) {
+		stopPushRunner_();
+	}
+	return result;
+}
+
+// Waits for the vsync notification newer than the last one.
+// Falls back to the server vsync request when the notifications stop.
+static unsigned int waitPushVsync_(void) {
+	unsigned int frame = ac.pushFrame;
+	while (ac.pushFrame == frame) {
+		if (tsync_mutex_wait_timeout(&ac.pushSignal, 100) != 0) {
+			printf("arvid_client: vsync notification timed out\n");
+			return waitServerVsync_();
+		}
+	}
+	return ac.pushFrame;
+}
+
+// Waits for the vsync signalled through the shared frame buffer.
+static unsigned int waitShmVsync_(void) {
+#ifdef __linux__
+	unsigned int seq = ac.shm->vsyncSeq;
+	struct timespec timeout;
+
+	while (ac.shm->vsyncSeq == seq) {
+		timeout.tv_sec = 0;
+		timeout.tv_nsec = 100 * 1000 * 1000;
+		if (syscall(SYS_futex, &ac.shm->vsyncSeq, FUTEX_WAIT, seq, &timeout, NULL, 0) != 0 &&
+			errno == ETIMEDOUT) {
+			printf("arvid_client: shared memory vsync timed out\n");
+			return waitServerVsync_();
+		}
+	}
+	ac.buttons = ac.shm->buttons;
+	return ac.shm->frameNumber;
+#else
+	return waitServerVsync_();
+#endif
 }
 
 unsigned int arvid_client_wait_for_vsync(void) {
 	int taskEnd = ac.cpuCores;
 	int i;
-	int result;
+	unsigned int result;
 
 	if (!ac.opened) {
 	    return 0;
 	}
 
+	TRACE_BEGIN(TRACE_VSYNC, 0);
 	//blitWait is only set in NON_BLOCKING blit
 	if (ac.blitWait) {
 		//now wait till all remaining rendering tasks have finished
+		TRACE_BEGIN(TRACE_WAIT_TASKS, taskEnd - 1);
 		for (i = 1; i < taskEnd; i++) {
 			tsync_mutex_wait(&at[i].mutexEnd);
 		}
+		TRACE_END(TRACE_WAIT_TASKS, taskEnd - 1);
 	}
 	ac.blitWait = 0;
+	//the video mode was set by a batch without the refresh rate
+	if (ac.vsyncModelStale) {
+		resetVsyncModel_();
+	}
 
-	ac.payload[0] = CMD_VSYNC; //wait for vsync
-	sendCommand_(1);
-	result = receiveResult_(10); //read 10 bytes
-
-	//store button status
-	{
-		unsigned char* data = (unsigned char*) ac.recv;
-		data += 6; //button status at index 6
-		ac.buttons = GET_INT(data);
+	//SHM: the local server signals the vsync directly
+	if (ac.shm != NULL) {
+		result = waitShmVsync_();
+	} else
+	//PUSH: the server notifies each vsync
+	if (ac.vsyncMode == ARVID_VSYNC_PUSH) {
+		result = waitPushVsync_();
+	} else
+	//LOCAL: predict the vsync, ask the server once in a while
+	if (ac.vsyncMode == ARVID_VSYNC_LOCAL && ac.vsyncSamples >= 2 &&
+		ac.vsyncLocalFrames < ac.vsyncSyncInterval) {
+		ac.vsyncLocalFrames++;
+		result = waitLocalVsync_();
+	} else {
+		result = waitServerVsync_();
+		//the local prediction was early, wait for the next vsync
+		if (result != 0 && result == ac.vsyncLastFrame && ac.vsyncLocalFrames > 0) {
+			result = waitServerVsync_();
+		}
+		if (result != 0) {
+			updateVsyncModel_(result);
+			ac.vsyncLocalFrames = 0;
+		}
 	}
-	return (unsigned int) result; 
+	//the display repeated the previous frame for each skipped vsync
+	if (result != 0 && ac.vsyncLastFrame != 0 && ac.vsyncBlitFrame != ac.frameCount &&
+		(int) (result - ac.vsyncLastFrame) > 1) {
+		ac.droppedFrames += result - ac.vsyncLastFrame - 1;
+	}
+	ac.vsyncBlitFrame = ac.frameCount;
+	ac.vsyncLastFrame = result;
+	TRACE_END(TRACE_VSYNC, result);
+	return result;
 }
 
 int arvid_client_get_button_status(void) {
@@ -567,6 +2466,7 @@ int arvid_client_get_button_status(void) {
 }
 
 int arvid_client_set_video_mode(int mode, int lines) {	
+	int result;
 	if (!ac.opened) {
 	    return -1;
 	}
@@ -576,10 +2476,22 @@ int arvid_client_set_video_mode(int mode, int lines) {
 	ac.width = 0;
 	ac.height = 0;
 	sendCommand_(3);
-	return receiveResult_(RESPONSE_SIZE);
+	result = receiveResultWait_(RESPONSE_SIZE, CMD_VIDEO_MODE_WAIT);
+	if (result == ARVID_CLIENT_ERROR_TIMEOUT) {
+		return result;
+	}
+
+	ac.videoMode = mode;
+	ac.videoLines = lines;
+	//the automatic pacing and the local vsync need to know the frame period
+	if (ac.pacingRate == 0 || ac.vsyncMode == ARVID_VSYNC_LOCAL) {
+		resetVsyncModel_();
+	}
+	return result;
 }
 
 int arvid_client_get_video_mode_lines(int mode, float frequency) {
+	int result;
 	int frq = frequency * 1000;
 	if (!ac.opened) {
 	    return -1;
@@ -589,12 +2501,18 @@ int arvid_client_get_video_mode_lines(int mode, float frequency) {
 	ac.payload[3] = SET_SHORT(frq);
 	sendCommand_(3);
 	ac.height = receiveResult_(RESPONSE_SIZE);
+	if (ac.height < 0) {
+		result = ac.height;
+		ac.height = 0;
+		return result;
+	}
 	printf("arvid_client: get video mode lines. mode=%i freq=%f lines=%i\n", mode, frequency, ac.height);
 	return ac.height;
 }
 
 
 float arvid_client_get_video_mode_refresh_rate(int mode, int lines) {
+	int result;
 	if (!ac.opened) {
 	    return 0;
 	}
@@ -604,10 +2522,15 @@ float arvid_client_get_video_mode_refresh_rate(int mode, int lines) {
 	ac.payload[3] = SET_SHORT(lines);
 
 	sendCommand_(3);
-	return (float) (receiveResult_(RESPONSE_SIZE) / 1000.0f);
+	result = receiveResult_(RESPONSE_SIZE);
+	if (result == ARVID_CLIENT_ERROR_TIMEOUT) {
+		return 0;
+	}
+	return (float) (result / 1000.0f);
 }
 
 int arvid_client_get_width(void) {
+	int result;
 	if (ac.width > 0) {
 		return ac.width;
 	}
@@ -616,11 +2539,15 @@ int arvid_client_get_width(void) {
 	}
 	ac.payload[0] = CMD_GET_WIDTH; //get width
 	sendCommand_(1);
-	ac.width = receiveResult_(RESPONSE_SIZE);
-	return ac.width;
+	result = receiveResult_(RESPONSE_SIZE);
+	if (result > 0) {
+		ac.width = result;
+	}
+	return result;
 }
 
 int arvid_client_get_height(void) {
+	int result;
 	if (ac.height > 0) {
 		return ac.height;
 	}
@@ -629,8 +2556,11 @@ int arvid_client_get_height(void) {
 	}
 	ac.payload[0] = CMD_GET_HEIGHT; //get height
 	sendCommand_(1);
-	ac.height = receiveResult_(RESPONSE_SIZE);
-	return ac.height;
+	result = receiveResult_(RESPONSE_SIZE);
+	if (result > 0) {
+		ac.height = result;
+	}
+	return result;
 }
 
 int arvid_client_enum_video_modes(arvid_client_vmode_info* vmodes, int maxItem) {
@@ -666,10 +2596,18 @@ int arvid_client_close(void) {
 		tsync_mutex_signal(&at[i].mutexStart); //wake up the task
 	}
 	
+	if (ac.vsyncMode == ARVID_VSYNC_PUSH) {
+		subscribeVsync_(0);
+		ac.vsyncMode = ARVID_VSYNC_SERVER;
+	}
+
 	ac.payload[0] = CMD_CLOSE; //close
 	sendCommand_(1);
 	result = receiveResult_(RESPONSE_SIZE);
 
+	arvid_client_set_capture_file(NULL);
+	closeShm_();
+	closeMetrics_();
 	close(ac.socketFd);
 	ac.socketFd = -1;
 	ac.height = 0;
@@ -684,10 +2622,94 @@ int arvid_client_close(void) {
 		tsync_mutex_close(&at[i].mutexStart);
 		tsync_mutex_close(&at[i].mutexEnd);
 	}
+	for (i = 0; i < ac.cpuCores; i++) {
+		free(at[i].convBuffer);
+		at[i].convBuffer = NULL;
+		at[i].convSize = 0;
+		free(at[i].scaleBuffer);
+		at[i].scaleBuffer = NULL;
+		at[i].scaleSize = 0;
+		free(at[i].orientBuffer);
+		at[i].orientBuffer = NULL;
+		at[i].orientSize = 0;
+	}
+	free(ac.scale.xMap);
+	ac.scale.xMap = NULL;
+	free(ac.lutBuffer);
+	ac.lutBuffer = NULL;
+	ac.lut = NULL;
 	disposeSockets_();
 	return result;
 }
 
+int arvid_client_set_capture_file(char* fileName) {
+	arvid_capture_header header;
+
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (ac.captureFile != NULL) {
+		fclose(ac.captureFile);
+		ac.captureFile = NULL;
+		printf("arvid_client: captured %u frames\n", ac.captureFrames);
+	}
+	if (fileName == NULL) {
+		return 0;
+	}
+	ac.captureFile = fopen(fileName, "wb");
+	if (ac.captureFile == NULL) {
+		printf("arvid_client: failed to create capture file %s\n", fileName);
+		return -2;
+	}
+	header.magic = ARVID_CAPTURE_MAGIC;
+	header.version = ARVID_CAPTURE_VERSION;
+	header.headerSize = sizeof(header);
+	header.frameHeaderSize = sizeof(arvid_capture_frame);
+	fwrite(&header, sizeof(header), 1, ac.captureFile);
+	ac.captureStart = tsync_get_time_us();
+	ac.captureFrames = 0;
+	return 0;
+}
+
+int arvid_client_set_trace(int enable) {
+	trace_thread_name(taskName_[0]);
+	trace_enable(enable);
+	return 0;
+}
+
+int arvid_client_dump_trace(char* fileName) {
+	if (fileName == NULL) {
+		return -1;
+	}
+	return trace_dump(fileName);
+}
+
+int arvid_client_set_cpu_cores(int cores) {
+	if (ac.opened) {
+	    return -1;
+	}
+	if (cores < 0 || cores > MAX_TASK) {
+		return -2;
+	}
+	cpuCoresLimit = cores;
+	return 0;
+}
+
+int arvid_client_set_metrics(int enable) {
+	metricsEnabled = enable ? 1 : 0;
+	if (!ac.opened) {
+		return 0;
+	}
+	if (enable && ac.metrics == NULL) {
+		openMetrics_();
+		return ac.metrics != NULL ? 0 : -3;
+	}
+	if (!enable) {
+		closeMetrics_();
+	}
+	return 0;
+}
+
 int arvid_client_set_blit_type(int type) {
 	if (!ac.opened) {
 	    return -1;
@@ -706,6 +2728,307 @@ int arvid_client_set_blit_type(int type) {
 	return 0;
 }
 
+int arvid_client_set_send_flags(int flags) {
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (flags & ~(ARVID_SEND_BATCH | ARVID_SEND_ZEROCOPY)) {
+	    return -2;
+	}
+#ifdef __linux__
+	if (flags & ARVID_SEND_ZEROCOPY) {
+		int one = 1;
+		if (setsockopt(ac.socketFd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0) {
+			printf("arvid_client: zero-copy send is not supported\n");
+			return -4;
+		}
+	}
+#else
+	//batched and zero-copy send are only available on Linux
+	if (flags != 0) {
+	    return -3;
+	}
+#endif
+	//wait till the non-blocking blit is finished
+	if (ac.blitWait) {
+		int i;
+		for (i = 1; i < ac.cpuCores; i++) {
+			tsync_mutex_wait(&at[i].mutexEnd);
+		}
+		ac.blitWait = 0;
+	}
+	ac.sendFlags = flags;
+	return 0;
+}
+
+int arvid_client_set_vsync_mode(int mode, int syncInterval) {
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (mode < ARVID_VSYNC_SERVER || mode > ARVID_VSYNC_PUSH || syncInterval < 1) {
+	    return -2;
+	}
+	if (mode == ac.vsyncMode) {
+		ac.vsyncSyncInterval = syncInterval;
+		return 0;
+	}
+	if (mode == ARVID_VSYNC_PUSH) {
+		int result = subscribeVsync_(1);
+		if (result < 0) {
+			printf("arvid_client: vsync subscription failed. %i\n", result);
+			return -3;
+		}
+	} else
+	if (ac.vsyncMode == ARVID_VSYNC_PUSH) {
+		subscribeVsync_(0);
+	}
+	if (mode == ARVID_VSYNC_LOCAL) {
+		resetVsyncModel_();
+	}
+	ac.vsyncMode = mode;
+	ac.vsyncSyncInterval = syncInterval;
+	return 0;
+}
+
+int arvid_client_set_command_timeout(int timeout) {
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (timeout < 1) {
+	    return -2;
+	}
+	ac.cmdTimeout = timeout;
+	return 0;
+}
+
+int arvid_client_set_fec(int groupSize) {
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (groupSize < 0 || groupSize > FEC_MAX_GROUP) {
+	    return -2;
+	}
+	ac.fecGroup = groupSize;
+	return 0;
+}
+
+void arvid_client_batch_init(arvid_client_batch* batch) {
+	if (batch != NULL) {
+		batch->count = 0;
+	}
+}
+
+int arvid_client_batch_add(arvid_client_batch* batch, int command, int arg1, int arg2) {
+	if (batch == NULL || batch->count >= ARVID_BATCH_MAX) {
+		return -1;
+	}
+	switch (command) {
+		case ARVID_BATCH_GET_FRAME_NUMBER:
+		case ARVID_BATCH_SET_VIDEO_MODE:
+		case ARVID_BATCH_GET_VIDEO_MODE_LINES:
+		case ARVID_BATCH_GET_VIDEO_MODE_FREQ:
+		case ARVID_BATCH_GET_WIDTH:
+		case ARVID_BATCH_GET_HEIGHT:
+		case ARVID_BATCH_GET_LINE_POS_MOD:
+		case ARVID_BATCH_SET_LINE_POS_MOD:
+		case ARVID_BATCH_SET_VIRTUAL_VSYNC:
+			break;
+		default:
+			return -2;
+	}
+	//the first sub-command has no previous result
+	if (arg2 == ARVID_BATCH_PREV_RESULT && batch->count == 0) {
+		return -3;
+	}
+	batch->command[batch->count] = command;
+	batch->arg[batch->count][0] = arg1;
+	batch->arg[batch->count][1] = arg2;
+	batch->result[batch->count] = 0;
+	return batch->count++;
+}
+
+int arvid_client_batch_send(arvid_client_batch* batch) {
+	int i;
+	int result;
+	int serverTime = 0;
+	unsigned short* cmd = &ac.payload[3];
+	unsigned char* data = (unsigned char*) ac.recv;
+
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (batch == NULL || batch->count < 1) {
+		return -2;
+	}
+
+	ac.payload[0] = CMD_BATCH;
+	//payload[1] is reserverd (contains packet id)
+	ac.payload[2] = SET_SHORT(batch->count);
+	for (i = 0; i < batch->count; i++) {
+		unsigned short command = batch->command[i];
+		if (batch->arg[i][1] == ARVID_BATCH_PREV_RESULT) {
+			command |= BATCH_ARG2_PREV;
+			cmd[2] = 0;
+		} else {
+			cmd[2] = SET_SHORT(batch->arg[i][1]);
+		}
+		cmd[0] = SET_SHORT(command);
+		cmd[1] = SET_SHORT(batch->arg[i][0]);
+		cmd += 3;
+		if (batch->command[i] == ARVID_BATCH_SET_VIDEO_MODE) {
+			serverTime = CMD_VIDEO_MODE_WAIT;
+		}
+	}
+	sendCommand_(2 + 3 * batch->count);
+	result = receiveResultWait_(2 + 4 * batch->count, serverTime);
+	if (result == ARVID_CLIENT_ERROR_TIMEOUT) {
+		return result;
+	}
+	if (ac.recvSize < 2 + 4 * batch->count) {
+		printf("arvid_client: batch is not supported by the server\n");
+		return -3;
+	}
+
+	//read the results and keep the client state in sync
+	data += 2; //skip the id
+	for (i = 0; i < batch->count; i++) {
+		batch->result[i] = GET_INT(data);
+		data += 4;
+	}
+	for (i = 0; i < batch->count; i++) {
+		int lines;
+		int rate;
+		int j;
+		switch (batch->command[i]) {
+			case ARVID_BATCH_SET_VIDEO_MODE:
+				//the server kept the previous mode
+				if (batch->result[i] < 0) {
+					break;
+				}
+				lines = batch->arg[i][1];
+				if (lines == ARVID_BATCH_PREV_RESULT) {
+					lines = batch->result[i - 1];
+				}
+				ac.videoMode = batch->arg[i][0];
+				ac.videoLines = lines;
+				ac.width = 0;
+				ac.height = 0;
+				if (ac.pacingRate != 0 && ac.vsyncMode != ARVID_VSYNC_LOCAL) {
+					break;
+				}
+				//take the refresh rate of the mode from the same batch
+				//or reset the vsync model at the next vsync
+				rate = 0;
+				for (j = 0; j < batch->count; j++) {
+					int freqLines = batch->arg[j][1];
+					if (freqLines == ARVID_BATCH_PREV_RESULT) {
+						freqLines = j > 0 ? batch->result[j - 1] : 0;
+					}
+					if (batch->command[j] == ARVID_BATCH_GET_VIDEO_MODE_FREQ &&
+						batch->arg[j][0] == ac.videoMode && freqLines == lines && batch->result[j] > 0) {
+						rate = batch->result[j];
+					}
+				}
+				if (rate > 0) {
+					setVsyncModel_(rate / 1000.0f);
+				} else {
+					ac.vsyncModelStale = 1;
+				}
+				break;
+			case ARVID_BATCH_GET_HEIGHT:
+				if (batch->result[i] > 0) {
+					ac.height = batch->result[i];
+				}
+				break;
+			case ARVID_BATCH_GET_WIDTH:
+				if (batch->result[i] > 0) {
+					ac.width = batch->result[i];
+				}
+				break;
+		}
+	}
+	return 0;
+}
+
+int arvid_client_set_frame_commit(int enable) {
+	if (!ac.opened) {
+	    return -1;
+	}
+	ac.frameCommit = enable ? 1 : 0;
+	return 0;
+}
+
+int arvid_client_set_nack(int enable) {
+	if (!ac.opened) {
+	    return -1;
+	}
+	ac.nack = enable ? 1 : 0;
+	return 0;
+}
+
+int arvid_client_set_tx_pacing(int rate, int framePercent) {
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (rate == 0 && (framePercent < 1 || framePercent > 100)) {
+	    return -2;
+	}
+	if (rate == 0) {
+		resetVsyncModel_();
+	}
+	ac.pacingPercent = framePercent;
+	ac.pacingRate = rate < 0 ? -1 : rate;
+	return 0;
+}
+
+int arvid_client_set_dither(int mode) {
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (mode < ARVID_DITHER_NONE || mode > ARVID_DITHER_TEMPORAL) {
+	    return -2;
+	}
+	ac.ditherMode = mode;
+	return 0;
+}
+
+int arvid_client_set_color_lut(const unsigned short* lut) {
+	unsigned short* next;
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (lut == NULL) {
+		ac.lut = NULL;
+		return 0;
+	}
+	if (ac.lutBuffer == NULL) {
+		ac.lutBuffer = (unsigned short*) malloc(2 * ARVID_LUT_SIZE * sizeof(unsigned short));
+		if (ac.lutBuffer == NULL) {
+			return -3;
+		}
+	}
+	//the frame being sent keeps its table, the next frame gets the other one
+	next = ac.lutSent == ac.lutBuffer ? ac.lutBuffer + ARVID_LUT_SIZE : ac.lutBuffer;
+	memcpy(next, lut, ARVID_LUT_SIZE * sizeof(unsigned short));
+	ac.lut = next;
+	return 0;
+}
+
+int arvid_client_set_rotation(int rotation) {
+	if (!ac.opened) {
+	    return -1;
+	}
+	if (rotation < 0 || rotation > (ARVID_ROTATE_270 | ARVID_FLIP_H | ARVID_FLIP_V)) {
+	    return -2;
+	}
+	ac.rotation = rotation;
+	return 0;
+}
+
+unsigned int arvid_client_get_tx_pacing_delay(void) {
+	return ac.pacingDelayLast;
+}
+
 int arvid_client_set_virtual_vsync(int vsyncLine) {
 	if (!ac.opened) {
 	    return -1;
@@ -713,7 +3036,7 @@ int arvid_client_set_virtual_vsync(int vsyncLine) {
 	ac.payload[0] = CMD_SET_VIRT_VSYNC; //set virtual vsync line or disable
 	//payload[1] is reserverd (contains packet id)
 	ac.payload[2] = SET_SHORT(vsyncLine );
-	sendCommand_(2);
+	sendCommandNoReply_(2);
 	return 0;
 }
 
@@ -724,7 +3047,7 @@ int arvid_client_set_line_pos_mod(short mod) {
 	ac.payload[0] = CMD_SET_LINE_MOD; //set line sync mod 
 	//payload[1] is reserverd (contains packet id)
 	ac.payload[2] = SET_SHORT(mod);
-	sendCommand_(2);
+	sendCommandNoReply_(2);
 	return 0;
 }
 
@@ -766,7 +3089,7 @@ int arvid_client_update_server(unsigned char* updateData, int updateSize) {
 	ac.payload[3] = SET_SHORT((updateSize >> 16));
 	
 	sendCommand_(3);
-	result = receiveResult_(RESPONSE_SIZE);
+	result = receiveResultWait_(RESPONSE_SIZE, CMD_UPDATE_WAIT);
 	if (result != 0) {
 		printf("Error: failed to upload update file. %i\n", result);
 		return result;
@@ -780,7 +3103,7 @@ int arvid_client_update_server(unsigned char* updateData, int updateSize) {
 		ac.payload[2] = SET_SHORT(index);
 		ac.payload[3] = SET_SHORT(block);
 		memcpy(&ac.payload[4], updateData, block);
-		sendCommand_(4 + ((block + 1) / 2));
+		sendCommandNoReply_(4 + ((block + 1) / 2));
 		updateData += block;
 		updateSize -= block;
 		index++;
@@ -794,7 +3117,7 @@ int arvid_client_update_server(unsigned char* updateData, int updateSize) {
 	ac.payload[3] = SET_SHORT((crc >> 16));
 	
 	sendCommand_(3);
-	result = receiveResult_(RESPONSE_SIZE);
+	result = receiveResultWait_(RESPONSE_SIZE, CMD_UPDATE_WAIT);
 	if (result != 0) {
 		printf("Error: failed to send update file. %i\n", result);
 		return 4;
@@ -0,0 +1,1269 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+// Arvid server emulator. Implements the udp protocol of the arvid-server
+// so the client can be tested and measured without the real hardware.
+// Blit strips are inflated into an in-memory RGB555 frame buffer which is
+// shown at the vsync generated at the refresh rate of the video mode.
+// The packets in both directions can pass through a network impairment
+// layer (loss, duplication, reordering, delay, jitter, bandwidth limit).
+// Linux only.
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/futex.h>
+
+#include "zlib.h"
+#include "crc.h"
+#include "arvid_shm.h"
+
+#define CMD_BLIT 1
+#define CMD_FRAME_NUMBER 2
+#define CMD_VSYNC 3
+#define CMD_SET_VIDEO_MODE 4
+#define CMD_GET_VIDEO_MODE_LINES 5
+#define CMD_GET_VIDEO_MODE_FREQ 6
+#define CMD_GET_WIDTH 7
+#define CMD_GET_HEIGHT 8
+#define CMD_ENUM_VIDEO_MODES 9
+#define CMD_INIT 11
+#define CMD_CLOSE 12
+#define CMD_BLIT_PARITY 13
+#define CMD_COMMIT_FRAME 14
+#define CMD_BATCH 15
+#define CMD_SUBSCRIBE_VSYNC 16
+#define CMD_VSYNC_PUSH 17
+
+#define CMD_GET_LINE_MOD 32
+#define CMD_SET_LINE_MOD 33
+#define CMD_SET_VIRT_VSYNC 34
+
+#define CMD_UPDATE_START 40
+#define CMD_UPDATE_PACKET 41
+#define CMD_UPDATE_END 42
+
+#define CMD_SERVER_POWEROFF 50
+
+#define DEFAULT_PORT 32100
+
+//horizontal line frequency (Hz), the refresh rate is LINE_RATE / lines
+#define LINE_RATE 15734
+#define MIN_LINES 262
+#define MAX_LINES 304
+#define MAX_WIDTH 640
+#define MODE_COUNT 13
+#define ERROR_ILLEGAL_VIDEO_MODE (-7)
+
+//blit and parity packet header size in bytes
+#define HEADER_SIZE 16
+#define MAX_PACKET (64 * 1024)
+#define MAX_STRIPS 64
+//pixels of a strip sent with other width than the video mode width
+#define MAX_STRIP_PIXELS (64 * 1024)
+#define MAX_PARITY 32
+#define NACK_MAX_STRIPS 32
+#define BATCH_ARG2_PREV 0x8000
+#define MAX_VSYNC_WAIT 16
+#define MAX_SUBSCRIBERS 4
+
+//widths of the video modes (see arvid.h)
+static const unsigned short modeWidth[MODE_COUNT] = {
+	320, 256, 288, 384, 240, 392, 400, 292, 336, 416, 448, 512, 640
+};
+
+//client waiting for the vsync response
+typedef struct emu_vsync_wait_t {
+	struct sockaddr_in addr;
+	unsigned short id;
+	char nack;					//response contains the missing strips
+	unsigned short frame;		//frame the client expects
+	int strips;
+} emu_vsync_wait;
+
+//frame currently being received
+typedef struct emu_frame_t {
+	char valid;
+	char shown;
+	char committed;
+	unsigned short frame;		//frame id
+	int strips;					//strip count, 0 - unknown
+	int received;				//number of received strips
+	unsigned long long bitmap;	//received strips
+	unsigned char* strip[MAX_STRIPS];	//received strip packets (for parity rebuild)
+	int stripSize[MAX_STRIPS];
+	unsigned char* parity[MAX_PARITY];	//parity packets waiting for the rebuild
+	int paritySize[MAX_PARITY];
+	int parityCount;
+} emu_frame;
+
+typedef struct emu_stat_t {
+	unsigned int packets;
+	unsigned long long bytes;
+	unsigned int strips;
+	unsigned int late;			//strips of older frames
+	unsigned int duplicate;
+	unsigned int bad;
+	unsigned int rebuilt;		//strips rebuilt from the parity
+	unsigned int commits;
+	unsigned int shown;			//frames shown
+	unsigned int incomplete;	//frames replaced before all strips arrived
+	unsigned int commands;
+	unsigned int dropped;		//packets dropped by the impairment layer
+	unsigned int queueDropped;	//packets dropped by the bandwidth limit
+	unsigned int duplicated;
+	unsigned int reordered;
+} emu_stat;
+
+//network impairment applied to the packets in both directions
+typedef struct emu_impair_t {
+	char enabled;
+	float loss;					//dropped packets (%)
+	float duplicate;			//duplicated packets (%)
+	float reorder;				//packets delayed to arrive out of order (%)
+	int reorderGap;				//extra delay of the reordered packets (usec)
+	int delay;					//one-way delay (usec)
+	int jitter;					//random delay added to the delay (usec)
+	int rate;					//bandwidth limit (bits per second), 0 - unlimited
+	int queue;					//max. time a packet waits for the bandwidth (usec)
+	unsigned int seed;
+	unsigned long long linkFree[2];	//time the link is free (outbound, inbound)
+} emu_impair;
+
+//packet waiting in the impairment layer
+typedef struct emu_delayed_t {
+	struct emu_delayed_t* next;
+	unsigned long long time;	//delivery time
+	char inbound;
+	struct sockaddr_in addr;
+	int size;
+	unsigned char data[1];
+} emu_delayed;
+
+typedef struct emu_data_t {
+	int fd;
+	int mode;
+	int lines;
+	int width;
+	short lineMod;
+	short virtVsync;
+	unsigned int buttons;
+	unsigned int frameNumber;
+	unsigned long long vsyncTime;	//time of the next vsync (usec)
+	unsigned short back[MAX_WIDTH * MAX_LINES];		//hidden frame buffer
+	unsigned short front[MAX_WIDTH * MAX_LINES];	//shown frame buffer
+	unsigned short strip[MAX_STRIP_PIXELS];		//strip with other row width
+	char untagged;					//strips without the frame tag arrived
+	z_stream zStream;
+	emu_frame fr;
+	emu_vsync_wait vsyncWait[MAX_VSYNC_WAIT];
+	int vsyncWaitCount;
+	struct sockaddr_in subscriber[MAX_SUBSCRIBERS];
+	int subscriberCount;
+	unsigned char* update;
+	int updateSize;
+	arvid_shm_header* shm;
+	unsigned int shmSize;
+	unsigned int shmCommitSeq;
+	emu_stat stat;
+	emu_stat statLast;
+} emu_data;
+
+static emu_data emu;
+static emu_impair im;
+static emu_delayed* delayed = NULL;
+
+static volatile char running = 1;
+static int port = DEFAULT_PORT;
+static char useShm = 0;
+static char verbose = 0;
+static char* dumpFile = NULL;
+static char doPrintHelp = 0;
+
+static unsigned long long getTime(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int getShort(unsigned char* data, int index) {
+	return data[index << 1] | (data[(index << 1) + 1] << 8);
+}
+
+static void setShort(unsigned char* data, int value) {
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+}
+
+static void setInt(unsigned char* data, int value) {
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+	data[3] = (value >> 24) & 0xFF;
+}
+
+static void impairPacket(int inbound, unsigned char* data, int size, struct sockaddr_in* addr);
+
+static void sendPacket(struct sockaddr_in* addr, unsigned char* data, int size) {
+	if (im.enabled) {
+		impairPacket(0, data, size, addr);
+		return;
+	}
+	sendto(emu.fd, data, size, 0, (struct sockaddr*) addr, sizeof(*addr));
+}
+
+static void reply(struct sockaddr_in* addr, unsigned short id, int result) {
+	unsigned char data[6];
+	setShort(data, id);
+	setInt(data + 2, result);
+	sendPacket(addr, data, sizeof(data));
+}
+
+static int getLines(int mode, int frequency) {
+	int lines;
+	(void) mode;
+	if (frequency < 50000) {
+		frequency = 50000;
+	} else
+	if (frequency > 61000) {
+		frequency = 61000;
+	}
+	lines = (int) (LINE_RATE * 1000.0 / frequency + 0.5);
+	if (lines < MIN_LINES) {
+		lines = MIN_LINES;
+	} else
+	if (lines > MAX_LINES) {
+		lines = MAX_LINES;
+	}
+	return lines;
+}
+
+static unsigned long long getFramePeriod(void) {
+	return (unsigned long long) emu.lines * 1000000 / LINE_RATE;
+}
+
+static int setVideoMode(int mode, int lines) {
+	if (mode < 0 || mode >= MODE_COUNT || lines < MIN_LINES || lines > MAX_LINES) {
+		return ERROR_ILLEGAL_VIDEO_MODE;
+	}
+	emu.mode = mode;
+	emu.lines = lines;
+	emu.width = modeWidth[mode];
+	memset(emu.back, 0, sizeof(emu.back));
+	memset(emu.front, 0, sizeof(emu.front));
+	if (emu.shm != NULL) {
+		emu.shm->width = emu.width;
+		emu.shm->height = emu.lines;
+	}
+	printf("arvid_emu: video mode %i (%ix%i) %.3f Hz\n", mode, emu.width, lines,
+		(float) LINE_RATE / lines);
+	return 0;
+}
+
+// Runs the command which has at most 2 arguments and responds by a single
+// value. Used by both the single commands and the batch.
+// Returns 0 if the command is not supported.
+static int runCommand(int cmd, int arg1, int arg2, int* result) {
+	switch (cmd) {
+		case CMD_FRAME_NUMBER:
+			*result = emu.frameNumber;
+			break;
+		case CMD_SET_VIDEO_MODE:
+			*result = setVideoMode(arg1, arg2);
+			break;
+		case CMD_GET_VIDEO_MODE_LINES:
+			*result = getLines(arg1, arg2);
+			break;
+		case CMD_GET_VIDEO_MODE_FREQ:
+			if (arg2 < MIN_LINES || arg2 > MAX_LINES) {
+				*result = ERROR_ILLEGAL_VIDEO_MODE;
+			} else {
+				*result = LINE_RATE * 1000 / arg2;
+			}
+			break;
+		case CMD_GET_WIDTH:
+			*result = emu.width;
+			break;
+		case CMD_GET_HEIGHT:
+			*result = emu.lines;
+			break;
+		case CMD_GET_LINE_MOD:
+			*result = emu.lineMod;
+			break;
+		case CMD_SET_LINE_MOD:
+			emu.lineMod = (short) arg1;
+			*result = 0;
+			break;
+		case CMD_SET_VIRT_VSYNC:
+			emu.virtVsync = (short) arg1;
+			*result = 0;
+			break;
+		default:
+			return 0;
+	}
+	return 1;
+}
+
+static void freeFrame(void) {
+	int i;
+	for (i = 0; i < MAX_STRIPS; i++) {
+		free(emu.fr.strip[i]);
+	}
+	for (i = 0; i < emu.fr.parityCount; i++) {
+		free(emu.fr.parity[i]);
+	}
+	memset(&emu.fr, 0, sizeof(emu.fr));
+}
+
+// Checks the frame tag of the strip. Strips of a newer frame start
+// the new frame, strips of older frames are dropped.
+static int acceptFrame(unsigned short frame) {
+	if (emu.fr.valid && frame == emu.fr.frame) {
+		return 1;
+	}
+	if (emu.fr.valid && (short) (frame - emu.fr.frame) < 0) {
+		return 0;
+	}
+	if (emu.fr.valid && !emu.fr.shown) {
+		emu.stat.incomplete++;
+	}
+	freeFrame();
+	emu.fr.valid = 1;
+	emu.fr.frame = frame;
+	return 1;
+}
+
+// Inflates the strip to the back buffer. The rows of the strip are
+// 'rowWidth' pixels wide, 0 - the width of the video mode.
+static void inflateStrip(unsigned char* data, int size, int posY, int rowWidth) {
+	int offset = posY * emu.width;
+	int bufferSize = emu.width * emu.lines;
+	int rows, i;
+	if (offset >= bufferSize) {
+		emu.stat.bad++;
+		return;
+	}
+	emu.zStream.next_in = data;
+	emu.zStream.avail_in = size;
+	if (rowWidth == 0 || rowWidth == emu.width) {
+		emu.zStream.next_out = (unsigned char*) &emu.back[offset];
+		emu.zStream.avail_out = (bufferSize - offset) << 1;
+		if (inflate(&emu.zStream, Z_FINISH) != Z_STREAM_END) {
+			emu.stat.bad++;
+		}
+		inflateReset(&emu.zStream);
+		return;
+	}
+	//place the rows one by one, the rest of the line is black
+	emu.zStream.next_out = (unsigned char*) emu.strip;
+	emu.zStream.avail_out = sizeof(emu.strip);
+	if (inflate(&emu.zStream, Z_FINISH) != Z_STREAM_END) {
+		emu.stat.bad++;
+	}
+	rows = (emu.zStream.total_out >> 1) / rowWidth;
+	inflateReset(&emu.zStream);
+	for (i = 0; i < rows && posY + i < emu.lines; i++, offset += emu.width) {
+		if (rowWidth < emu.width) {
+			memcpy(&emu.back[offset], &emu.strip[i * rowWidth], rowWidth << 1);
+			memset(&emu.back[offset + rowWidth], 0, (emu.width - rowWidth) << 1);
+		} else {
+			memcpy(&emu.back[offset], &emu.strip[i * rowWidth], emu.width << 1);
+		}
+	}
+}
+
+static void tryRebuild(void);
+
+static void handleBlit(unsigned char* data, int size) {
+	int dataSize = getShort(data, 1);
+	int posY = getShort(data, 2);
+	int strip = getShort(data, 3);
+	unsigned short frame = getShort(data, 4);
+	int strips = getShort(data, 5);
+	int rowWidth = getShort(data, 6);
+
+	if (size < HEADER_SIZE + dataSize) {
+		emu.stat.bad++;
+		return;
+	}
+	//older clients do not tag the strips
+	if (strips == 0) {
+		emu.untagged = 1;
+		inflateStrip(data + HEADER_SIZE, dataSize, posY, rowWidth);
+		emu.stat.strips++;
+		return;
+	}
+	if (!acceptFrame(frame)) {
+		emu.stat.late++;
+		return;
+	}
+	emu.fr.strips = strips;
+	if (strip < MAX_STRIPS) {
+		if (emu.fr.bitmap & (1ULL << strip)) {
+			emu.stat.duplicate++;
+			return;
+		}
+		emu.fr.bitmap |= (1ULL << strip);
+		emu.fr.strip[strip] = malloc(size);
+		memcpy(emu.fr.strip[strip], data, size);
+		emu.fr.stripSize[strip] = size;
+	}
+	emu.fr.received++;
+	emu.stat.strips++;
+	inflateStrip(data + HEADER_SIZE, dataSize, posY, rowWidth);
+	if (emu.fr.parityCount > 0) {
+		tryRebuild();
+	}
+}
+
+// Finds the received strip of the current frame starting at the line.
+static int findStrip(int posY) {
+	int i;
+	for (i = 0; i < MAX_STRIPS; i++) {
+		if (emu.fr.strip[i] != NULL && getShort(emu.fr.strip[i], 2) == posY) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Rebuilds a single lost strip of the group from the parity packet.
+// Returns 1 when the parity packet is no longer needed.
+static int rebuildStrip(unsigned char* parity, int paritySize) {
+	int dataSize = getShort(parity, 1);
+	int posY = getShort(parity, 2);
+	int count = getShort(parity, 3);
+	int lines = getShort(parity, 4);
+	int missingY = -1;
+	unsigned char* packet;
+	int i, j;
+
+	if (paritySize < HEADER_SIZE + dataSize || dataSize < HEADER_SIZE) {
+		emu.stat.bad++;
+		return 1;
+	}
+	for (i = 0; i < count; i++) {
+		if (findStrip(posY + i * lines) < 0) {
+			if (missingY >= 0) {
+				return 0; //more strips missing, some may still arrive
+			}
+			missingY = posY + i * lines;
+		}
+	}
+	if (missingY < 0) {
+		return 1;
+	}
+	packet = malloc(dataSize);
+	memcpy(packet, parity + HEADER_SIZE, dataSize);
+	for (i = 0; i < count; i++) {
+		int index = findStrip(posY + i * lines);
+		if (index >= 0) {
+			unsigned char* strip = emu.fr.strip[index];
+			int size = emu.fr.stripSize[index];
+			if (size > dataSize) {
+				size = dataSize;
+			}
+			for (j = 0; j < size; j++) {
+				packet[j] ^= strip[j];
+			}
+		}
+	}
+	if (getShort(packet, 0) == CMD_BLIT && getShort(packet, 2) == missingY) {
+		emu.stat.rebuilt++;
+		handleBlit(packet, dataSize);
+	} else {
+		emu.stat.bad++;
+	}
+	free(packet);
+	return 1;
+}
+
+static void tryRebuild(void) {
+	int i = 0;
+	while (i < emu.fr.parityCount) {
+		unsigned char* parity = emu.fr.parity[i];
+		int paritySize = emu.fr.paritySize[i];
+		//remove the parity first, the rebuild may call this function again
+		emu.fr.parityCount--;
+		emu.fr.parity[i] = emu.fr.parity[emu.fr.parityCount];
+		emu.fr.paritySize[i] = emu.fr.paritySize[emu.fr.parityCount];
+		if (rebuildStrip(parity, paritySize)) {
+			free(parity);
+			i = 0;
+		} else {
+			emu.fr.parity[emu.fr.parityCount] = parity;
+			emu.fr.paritySize[emu.fr.parityCount] = paritySize;
+			emu.fr.parityCount++;
+			i++;
+		}
+	}
+}
+
+static void handleParity(unsigned char* data, int size) {
+	unsigned short frame = getShort(data, 5);
+	if (!acceptFrame(frame)) {
+		emu.stat.late++;
+		return;
+	}
+	if (emu.fr.parityCount >= MAX_PARITY) {
+		return;
+	}
+	emu.fr.parity[emu.fr.parityCount] = malloc(size);
+	memcpy(emu.fr.parity[emu.fr.parityCount], data, size);
+	emu.fr.paritySize[emu.fr.parityCount] = size;
+	emu.fr.parityCount++;
+	tryRebuild();
+}
+
+static void handleCommit(unsigned char* data, int size) {
+	unsigned short frame = getShort(data, 1);
+	(void) size;
+	if (emu.fr.valid && frame == emu.fr.frame && !emu.fr.committed) {
+		emu.fr.committed = 1;
+		emu.fr.strips = getShort(data, 2);
+		emu.stat.commits++;
+	}
+}
+
+// Returns the bitmap of strips of the frame that did not arrive yet.
+static unsigned int getMissingStrips(unsigned short frame, int strips) {
+	unsigned int missing = 0;
+	int i;
+	if (strips > NACK_MAX_STRIPS) {
+		strips = NACK_MAX_STRIPS;
+	}
+	//no strip of the frame arrived yet
+	if (!emu.fr.valid || (short) (frame - emu.fr.frame) > 0) {
+		return strips == 32 ? 0xFFFFFFFF : (1u << strips) - 1;
+	}
+	//the frame was replaced by a newer one
+	if (frame != emu.fr.frame) {
+		return 0;
+	}
+	for (i = 0; i < strips; i++) {
+		if (!(emu.fr.bitmap & (1ULL << i))) {
+			missing |= (1u << i);
+		}
+	}
+	return missing;
+}
+
+static void handleVsync(unsigned char* data, int size, struct sockaddr_in* addr) {
+	emu_vsync_wait* w;
+	unsigned short id = getShort(data, 1);
+	int i;
+
+	//the command was resent
+	for (i = 0; i < emu.vsyncWaitCount; i++) {
+		w = &emu.vsyncWait[i];
+		if (w->id == id && w->addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+			w->addr.sin_port == addr->sin_port) {
+			return;
+		}
+	}
+	if (emu.vsyncWaitCount >= MAX_VSYNC_WAIT) {
+		return;
+	}
+	w = &emu.vsyncWait[emu.vsyncWaitCount++];
+	w->addr = *addr;
+	w->id = id;
+	w->nack = size >= 8;
+	if (w->nack) {
+		w->strips = getShort(data, 2);
+		w->frame = getShort(data, 3);
+	}
+}
+
+static void handleEnum(unsigned short id, struct sockaddr_in* addr) {
+	unsigned char data[6 + MODE_COUNT * 4];
+	unsigned char* item = data + 6;
+	char used[MODE_COUNT];
+	int i, j;
+
+	setShort(data, id);
+	setInt(data + 2, MODE_COUNT);
+	memset(used, 0, sizeof(used));
+	//sorted in descending order according the width
+	for (i = 0; i < MODE_COUNT; i++) {
+		int best = -1;
+		for (j = 0; j < MODE_COUNT; j++) {
+			if (!used[j] && (best < 0 || modeWidth[j] > modeWidth[best])) {
+				best = j;
+			}
+		}
+		used[best] = 1;
+		setShort(item, modeWidth[best]);
+		setShort(item + 2, best);
+		item += 4;
+	}
+	sendPacket(addr, data, sizeof(data));
+}
+
+static void handleBatch(unsigned char* data, int size, struct sockaddr_in* addr) {
+	unsigned char response[2 + 64 * 4];
+	int count = getShort(data, 2);
+	int prev = 0;
+	int i;
+
+	if (count > 64 || size < (3 + count * 3) * 2) {
+		emu.stat.bad++;
+		return;
+	}
+	setShort(response, getShort(data, 1));
+	for (i = 0; i < count; i++) {
+		int cmd = getShort(data, 3 + i * 3);
+		int arg1 = getShort(data, 4 + i * 3);
+		int arg2 = getShort(data, 5 + i * 3);
+		int result = -1;
+		if (cmd & BATCH_ARG2_PREV) {
+			cmd &= ~BATCH_ARG2_PREV;
+			arg2 = prev;
+		}
+		runCommand(cmd, arg1, arg2, &result);
+		setInt(response + 2 + i * 4, result);
+		prev = result;
+	}
+	sendPacket(addr, response, 2 + count * 4);
+}
+
+static void handleSubscribe(unsigned char* data, struct sockaddr_in* addr) {
+	struct sockaddr_in target = *addr;
+	int pushPort = getShort(data, 2);
+	int i;
+
+	for (i = 0; i < emu.subscriberCount; i++) {
+		if (emu.subscriber[i].sin_addr.s_addr == addr->sin_addr.s_addr) {
+			emu.subscriber[i] = emu.subscriber[--emu.subscriberCount];
+			break;
+		}
+	}
+	if (pushPort != 0 && emu.subscriberCount < MAX_SUBSCRIBERS) {
+		target.sin_port = htons(pushPort);
+		emu.subscriber[emu.subscriberCount++] = target;
+	}
+}
+
+static int handleUpdate(int cmd, unsigned char* data, int size) {
+	unsigned int crc;
+	int index;
+	int block;
+
+	switch (cmd) {
+		case CMD_UPDATE_START:
+			free(emu.update);
+			emu.updateSize = getShort(data, 2) | (getShort(data, 3) << 16);
+			emu.update = calloc(1, emu.updateSize + 1024);
+			printf("arvid_emu: update start. size=%i\n", emu.updateSize);
+			return emu.update == NULL ? -1 : 0;
+		case CMD_UPDATE_PACKET:
+			index = getShort(data, 2);
+			block = getShort(data, 3);
+			if (emu.update != NULL && block <= 1024 && size >= 8 + block &&
+				index * 1024 + block <= emu.updateSize) {
+				memcpy(emu.update + index * 1024, data + 8, block);
+			}
+			return 0;
+		case CMD_UPDATE_END:
+			if (emu.update == NULL) {
+				return -1;
+			}
+			crc = getShort(data, 2) | (getShort(data, 3) << 16);
+			if (crc != crc_calc(emu.update, emu.updateSize)) {
+				printf("arvid_emu: update crc mismatch\n");
+				return -1;
+			}
+			printf("arvid_emu: update received. crc=0x%08x\n", crc);
+			return 0;
+	}
+	return -1;
+}
+
+static void handlePacket(unsigned char* data, int size, struct sockaddr_in* addr) {
+	int cmd;
+	unsigned short id;
+	int result = 0;
+
+	if (size < 2) {
+		return;
+	}
+	emu.stat.packets++;
+	emu.stat.bytes += size;
+	cmd = getShort(data, 0);
+	id = size >= 4 ? getShort(data, 1) : 0;
+
+	switch (cmd) {
+		case CMD_BLIT:
+			if (size >= HEADER_SIZE) {
+				handleBlit(data, size);
+			}
+			return;
+		case CMD_BLIT_PARITY:
+			if (size >= HEADER_SIZE) {
+				handleParity(data, size);
+			}
+			return;
+		case CMD_COMMIT_FRAME:
+			if (size >= 6) {
+				handleCommit(data, size);
+			}
+			return;
+	}
+
+	emu.stat.commands++;
+	switch (cmd) {
+		case CMD_VSYNC:
+			handleVsync(data, size, addr);
+			return;
+		case CMD_ENUM_VIDEO_MODES:
+			handleEnum(id, addr);
+			return;
+		case CMD_BATCH:
+			handleBatch(data, size, addr);
+			return;
+		case CMD_INIT:
+			printf("arvid_emu: client %s:%i connected\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+			break;
+		case CMD_CLOSE:
+			printf("arvid_emu: client %s:%i disconnected\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+			break;
+		case CMD_SUBSCRIBE_VSYNC:
+			handleSubscribe(data, addr);
+			break;
+		case CMD_SET_LINE_MOD:
+		case CMD_SET_VIRT_VSYNC:
+			//not responded, sent several times
+			runCommand(cmd, (short) getShort(data, 2), 0, &result);
+			return;
+		case CMD_UPDATE_PACKET:
+			handleUpdate(cmd, data, size);
+			return;
+		case CMD_UPDATE_START:
+		case CMD_UPDATE_END:
+			result = handleUpdate(cmd, data, size);
+			break;
+		case CMD_SERVER_POWEROFF:
+			printf("arvid_emu: power off\n");
+			running = 0;
+			break;
+		default:
+			if (!runCommand(cmd, size >= 6 ? getShort(data, 2) : 0,
+				size >= 8 ? getShort(data, 3) : 0, &result)) {
+				emu.stat.bad++;
+				return;
+			}
+	}
+	reply(addr, id, result);
+}
+
+// Shows the committed frame of the shared frame buffer.
+static void showShmFrame(void) {
+	unsigned short* src;
+	int lines = emu.lines;
+	int i;
+
+	if (emu.shm->commitSeq == emu.shmCommitSeq) {
+		return;
+	}
+	emu.shmCommitSeq = emu.shm->commitSeq;
+	src = (unsigned short*) (((char*) emu.shm) + emu.shm->bufferOffset);
+	src += (emu.shm->commitIndex % ARVID_SHM_BUFFERS) * emu.shm->bufferStride * emu.shm->bufferLines;
+	if (lines > (int) emu.shm->bufferLines) {
+		lines = (int) emu.shm->bufferLines;
+	}
+	for (i = 0; i < lines; i++) {
+		memcpy(&emu.front[i * emu.width], src, emu.width << 1);
+		src += emu.shm->bufferStride;
+	}
+	emu.stat.shown++;
+}
+
+static void vsync(void) {
+	unsigned char data[14];
+	int i;
+
+	//show the hidden frame buffer when its frame is complete
+	if (emu.fr.valid && !emu.fr.shown && emu.fr.strips > 0 && emu.fr.received >= emu.fr.strips) {
+		memcpy(emu.front, emu.back, sizeof(emu.front));
+		emu.fr.shown = 1;
+		emu.stat.shown++;
+	} else
+	if (emu.untagged) {
+		memcpy(emu.front, emu.back, sizeof(emu.front));
+		emu.untagged = 0;
+		emu.stat.shown++;
+	}
+	if (emu.shm != NULL) {
+		showShmFrame();
+	}
+	emu.frameNumber++;
+
+	//respond the clients waiting for the vsync
+	for (i = 0; i < emu.vsyncWaitCount; i++) {
+		emu_vsync_wait* w = &emu.vsyncWait[i];
+		setShort(data, w->id);
+		setInt(data + 2, emu.frameNumber);
+		setInt(data + 6, emu.buttons);
+		if (w->nack) {
+			setInt(data + 10, getMissingStrips(w->frame, w->strips));
+		}
+		sendPacket(&w->addr, data, w->nack ? 14 : 10);
+	}
+	emu.vsyncWaitCount = 0;
+
+	//notify the subscribers
+	setShort(data, CMD_VSYNC_PUSH);
+	setInt(data + 2, emu.frameNumber);
+	setInt(data + 6, emu.buttons);
+	for (i = 0; i < emu.subscriberCount; i++) {
+		sendPacket(&emu.subscriber[i], data, 10);
+	}
+
+	if (emu.shm != NULL) {
+		emu.shm->frameNumber = emu.frameNumber;
+		emu.shm->buttons = emu.buttons;
+		__sync_fetch_and_add(&emu.shm->vsyncSeq, 1);
+		syscall(SYS_futex, &emu.shm->vsyncSeq, FUTEX_WAKE, 0x7FFFFFFF, NULL, NULL, 0);
+	}
+}
+
+static int createShm(void) {
+	int fd;
+	unsigned int offset = 4096;
+	unsigned int size = offset + ARVID_SHM_BUFFERS * MAX_WIDTH * MAX_LINES * 2;
+
+	fd = shm_open(ARVID_SHM_NAME, O_RDWR | O_CREAT, 0666);
+	if (fd < 0) {
+		return -1;
+	}
+	if (ftruncate(fd, size) != 0) {
+		close(fd);
+		return -1;
+	}
+	emu.shm = (arvid_shm_header*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (emu.shm == MAP_FAILED) {
+		emu.shm = NULL;
+		return -1;
+	}
+	memset(emu.shm, 0, offset);
+	emu.shm->version = ARVID_SHM_VERSION;
+	emu.shm->size = size;
+	emu.shm->bufferOffset = offset;
+	emu.shm->bufferStride = MAX_WIDTH;
+	emu.shm->bufferLines = MAX_LINES;
+	emu.shm->width = emu.width;
+	emu.shm->height = emu.lines;
+	emu.shm->magic = ARVID_SHM_MAGIC;
+	emu.shmSize = size;
+	printf("arvid_emu: shared memory frame buffer " ARVID_SHM_NAME "\n");
+	return 0;
+}
+
+static void closeShm(void) {
+	if (emu.shm != NULL) {
+		munmap(emu.shm, emu.shmSize);
+		shm_unlink(ARVID_SHM_NAME);
+		emu.shm = NULL;
+	}
+}
+
+// Writes the shown frame buffer to a binary PPM file.
+static void dumpFrame(char* name) {
+	FILE* f = fopen(name, "wb");
+	int i;
+	if (f == NULL) {
+		printf("arvid_emu: failed to create file %s\n", name);
+		return;
+	}
+	fprintf(f, "P6\n%i %i\n255\n", emu.width, emu.lines);
+	for (i = 0; i < emu.width * emu.lines; i++) {
+		unsigned short p = emu.front[i];
+		unsigned char rgb[3];
+		rgb[0] = ((p >> 10) & 0x1F) << 3;
+		rgb[1] = ((p >> 5) & 0x1F) << 3;
+		rgb[2] = (p & 0x1F) << 3;
+		fwrite(rgb, 1, 3, f);
+	}
+	fclose(f);
+	printf("arvid_emu: frame written to %s\n", name);
+}
+
+// Returns a pseudo random number (xorshift), the sequence is
+// reproducible for the same seed.
+static unsigned int getRandom(void) {
+	unsigned int x = im.seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	im.seed = x;
+	return x;
+}
+
+static float getRandomPercent(void) {
+	return (getRandom() % 100000) / 1000.0f;
+}
+
+// Inserts the packet to the delivery queue sorted by the delivery time.
+static void queuePacket(unsigned long long time, int inbound, unsigned char* data, int size, struct sockaddr_in* addr) {
+	emu_delayed* packet = malloc(sizeof(emu_delayed) + size);
+	emu_delayed** prev = &delayed;
+
+	if (packet == NULL) {
+		return;
+	}
+	packet->time = time;
+	packet->inbound = inbound;
+	packet->addr = *addr;
+	packet->size = size;
+	memcpy(packet->data, data, size);
+	while (*prev != NULL && (*prev)->time <= time) {
+		prev = &(*prev)->next;
+	}
+	packet->next = *prev;
+	*prev = packet;
+}
+
+// Applies the network impairment to the packet and queues it for
+// the delivery (inbound) or for sending (outbound).
+static void impairPacket(int inbound, unsigned char* data, int size, struct sockaddr_in* addr) {
+	unsigned long long now = getTime();
+	unsigned long long time = now;
+	int copies = 1;
+	int i;
+
+	if (im.loss > 0 && getRandomPercent() < im.loss) {
+		emu.stat.dropped++;
+		return;
+	}
+	//the packet waits till the previous packets are transferred
+	if (im.rate > 0) {
+		unsigned long long* linkFree = &im.linkFree[inbound];
+		if (*linkFree < now) {
+			*linkFree = now;
+		}
+		if (*linkFree - now > (unsigned long long) im.queue) {
+			emu.stat.queueDropped++;
+			return;
+		}
+		*linkFree += (unsigned long long) size * 8 * 1000000 / im.rate;
+		time = *linkFree;
+	}
+	if (im.duplicate > 0 && getRandomPercent() < im.duplicate) {
+		emu.stat.duplicated++;
+		copies = 2;
+	}
+	for (i = 0; i < copies; i++) {
+		unsigned long long t = time + im.delay;
+		if (im.jitter > 0) {
+			t += getRandom() % im.jitter;
+		}
+		if (im.reorder > 0 && getRandomPercent() < im.reorder) {
+			emu.stat.reordered++;
+			t += im.reorderGap;
+		}
+		queuePacket(t, inbound, data, size, addr);
+	}
+}
+
+// Delivers the queued packets which are due.
+static void deliverPackets(unsigned long long now) {
+	while (delayed != NULL && delayed->time <= now) {
+		emu_delayed* packet = delayed;
+		delayed = packet->next;
+		if (packet->inbound) {
+			handlePacket(packet->data, packet->size, &packet->addr);
+		} else {
+			sendto(emu.fd, packet->data, packet->size, 0, (struct sockaddr*) &packet->addr, sizeof(packet->addr));
+		}
+		free(packet);
+	}
+}
+
+static void freePackets(void) {
+	while (delayed != NULL) {
+		emu_delayed* packet = delayed;
+		delayed = packet->next;
+		free(packet);
+	}
+}
+
+// Sets the impairment parameter. Times are in milliseconds,
+// the bandwidth in kbits per second.
+// Returns 0 if the parameter is unknown.
+static int setImpairParam(char* name, char* value) {
+	if (strcmp(name, "loss") == 0) {
+		im.loss = atof(value);
+	} else
+	if (strcmp(name, "dup") == 0) {
+		im.duplicate = atof(value);
+	} else
+	if (strcmp(name, "reorder") == 0) {
+		im.reorder = atof(value);
+	} else
+	if (strcmp(name, "reorder_gap") == 0) {
+		im.reorderGap = (int) (atof(value) * 1000);
+	} else
+	if (strcmp(name, "delay") == 0) {
+		im.delay = (int) (atof(value) * 1000);
+	} else
+	if (strcmp(name, "jitter") == 0) {
+		im.jitter = (int) (atof(value) * 1000);
+	} else
+	if (strcmp(name, "rate") == 0) {
+		im.rate = (int) (atof(value) * 1000);
+	} else
+	if (strcmp(name, "queue") == 0) {
+		im.queue = (int) (atof(value) * 1000);
+	} else
+	if (strcmp(name, "seed") == 0) {
+		im.seed = (unsigned int) strtoul(value, NULL, 0);
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+// Reads the impairment parameters from the config file.
+// Each line contains 'name = value', '#' starts a comment.
+static int readConfig(char* fileName) {
+	FILE* f = fopen(fileName, "r");
+	char line[256];
+	int lineNumber = 0;
+
+	if (f == NULL) {
+		printf("arvid_emu: failed to open config file %s\n", fileName);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char name[64];
+		char value[64];
+		char* comment = strchr(line, '#');
+		lineNumber++;
+		if (comment != NULL) {
+			*comment = 0;
+		}
+		if (sscanf(line, " %63[a-z_] = %63s", name, value) == 2) {
+			if (!setImpairParam(name, value)) {
+				printf("arvid_emu: %s:%i unknown parameter '%s'\n", fileName, lineNumber, name);
+			}
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static void printStat(void) {
+	emu_stat* s = &emu.stat;
+	emu_stat* l = &emu.statLast;
+	printf("arvid_emu: frame=%u shown=%u strips=%u late=%u dup=%u rebuilt=%u "
+		"incomplete=%u commits=%u cmds=%u bad=%u kbytes=%llu\n",
+		emu.frameNumber, s->shown - l->shown, s->strips - l->strips, s->late - l->late,
+		s->duplicate - l->duplicate, s->rebuilt - l->rebuilt, s->incomplete - l->incomplete,
+		s->commits - l->commits, s->commands - l->commands, s->bad - l->bad,
+		(s->bytes - l->bytes) >> 10);
+	if (im.enabled) {
+		printf("arvid_emu: impair dropped=%u queue_dropped=%u duplicated=%u reordered=%u\n",
+			s->dropped - l->dropped, s->queueDropped - l->queueDropped,
+			s->duplicated - l->duplicated, s->reordered - l->reordered);
+	}
+	emu.statLast = emu.stat;
+}
+
+static void stop(int sig) {
+	(void) sig;
+	running = 0;
+}
+
+static void checkParams(int argc, char** argv) {
+	int i;
+	for (i = 1; i < argc; i++) {
+		char* arg = argv[i];
+		if (strcmp(arg, "-port") == 0 && i + 1 < argc) {
+			port = atoi(argv[++i]);
+		} else
+		if (strcmp(arg, "-shm") == 0) {
+			useShm = 1;
+		} else
+		if (strcmp(arg, "-dump") == 0 && i + 1 < argc) {
+			dumpFile = argv[++i];
+		} else
+		if (strcmp(arg, "-v") == 0) {
+			verbose = 1;
+		} else
+		if (strcmp(arg, "-config") == 0 && i + 1 < argc) {
+			if (readConfig(argv[++i]) != 0) {
+				doPrintHelp = 1;
+			}
+		} else
+		//impairment parameters: -loss 1.5 etc.
+		if (arg[0] == '-' && i + 1 < argc && setImpairParam(arg + 1, argv[i + 1])) {
+			i++;
+		} else {
+			doPrintHelp = 1;
+		}
+	}
+}
+
+static void printHelp(void) {
+	printf("Arvid server emulator.\n");
+	printf("usage: arvid_emu [-port udp_port] [-shm] [-dump file.ppm] [-v] [impairment options]\n");
+	printf("  -port : udp port to listen on (default %i)\n", DEFAULT_PORT);
+	printf("  -shm  : expose the shared-memory frame buffer for local clients\n");
+	printf("  -dump : write the last shown frame to the PPM file on exit\n");
+	printf("  -v    : print statistics every second\n");
+	printf("network impairment (both directions):\n");
+	printf("  -loss pct        : dropped packets\n");
+	printf("  -dup pct         : duplicated packets\n");
+	printf("  -reorder pct     : packets delayed by reorder_gap to arrive out of order\n");
+	printf("  -reorder_gap ms  : extra delay of the reordered packets (default 1)\n");
+	printf("  -delay ms        : one-way delay\n");
+	printf("  -jitter ms       : random delay (0 - jitter) added to the delay\n");
+	printf("  -rate kbit/s     : bandwidth limit\n");
+	printf("  -queue ms        : max. queueing delay of the bandwidth limit (default 50)\n");
+	printf("  -seed n          : random seed\n");
+	printf("  -config file     : reads the parameters from file (name = value lines)\n");
+}
+
+int main(int argc, char** argv) {
+	static unsigned char data[MAX_PACKET];
+	struct sockaddr_in addr;
+	unsigned long long statTime;
+
+	im.reorderGap = 1000;
+	im.queue = 50000;
+	im.seed = 1;
+	checkParams(argc, argv);
+	if (doPrintHelp) {
+		printHelp();
+		return -1;
+	}
+
+	memset(&emu, 0, sizeof(emu));
+	emu.virtVsync = -1;
+	//arvid starts in 320 x 240 60Hz mode
+	setVideoMode(0, getLines(0, 60000));
+	if (inflateInit2(&emu.zStream, -15) != Z_OK) {
+		return 1;
+	}
+
+	emu.fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (emu.fd < 0 || bind(emu.fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+		printf("arvid_emu: failed to bind port %i\n", port);
+		return 1;
+	}
+	if (useShm && createShm() != 0) {
+		printf("arvid_emu: failed to create the shared memory frame buffer\n");
+	}
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	printf("arvid_emu: listening on port %i\n", port);
+	im.enabled = im.loss > 0 || im.duplicate > 0 || im.reorder > 0 ||
+		im.delay > 0 || im.jitter > 0 || im.rate > 0;
+	if (im.enabled) {
+		if (im.seed == 0) {
+			im.seed = 1;
+		}
+		printf("arvid_emu: impairment loss=%.2f%% dup=%.2f%% reorder=%.2f%% gap=%ius "
+			"delay=%ius jitter=%ius rate=%ibit/s queue=%ius\n", im.loss, im.duplicate,
+			im.reorder, im.reorderGap, im.delay, im.jitter, im.rate, im.queue);
+	}
+
+	emu.vsyncTime = getTime() + getFramePeriod();
+	statTime = getTime() + 1000000;
+	while (running) {
+		unsigned long long now = getTime();
+		unsigned long long wake;
+		struct pollfd pfd;
+		struct timespec timeout;
+
+		deliverPackets(now);
+
+		if (now >= emu.vsyncTime) {
+			vsync();
+			emu.vsyncTime += getFramePeriod();
+			//do not try to catch up after a stall
+			if (emu.vsyncTime < now) {
+				emu.vsyncTime = now + getFramePeriod();
+			}
+			if (verbose && now >= statTime) {
+				printStat();
+				statTime += 1000000;
+			}
+			continue;
+		}
+		wake = emu.vsyncTime;
+		if (delayed != NULL && delayed->time < wake) {
+			wake = delayed->time > now ? delayed->time : now;
+		}
+		timeout.tv_sec = 0;
+		timeout.tv_nsec = (wake - now) * 1000;
+		pfd.fd = emu.fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (ppoll(&pfd, 1, &timeout, NULL) > 0) {
+			while (1) {
+				socklen_t addrSize = sizeof(addr);
+				int size = recvfrom(emu.fd, data, sizeof(data), MSG_DONTWAIT,
+					(struct sockaddr*) &addr, &addrSize);
+				if (size < 0) {
+					break;
+				}
+				if (im.enabled) {
+					impairPacket(1, data, size, &addr);
+				} else {
+					handlePacket(data, size, &addr);
+				}
+			}
+		}
+	}
+
+	if (dumpFile != NULL) {
+		dumpFrame(dumpFile);
+	}
+	closeShm();
+	freePackets();
+	freeFrame();
+	inflateEnd(&emu.zStream);
+	close(emu.fd);
+	return 0;
+}
@@ -0,0 +1,83 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+#ifndef _ARVID_METRICS_H_
+#define _ARVID_METRICS_H_
+
+/*
+Live metrics published by a connected client (Linux only).
+
+When the metrics are enabled (arvid_client_set_metrics or the
+ARVID_METRICS=1 environment variable), each client process creates the
+segment ARVID_METRICS_NAME followed by its pid (ie. /arvid_metrics.1234)
+when it connects and removes it when it closes the connection. Segments
+left by crashed clients are removed by arvid_stat. The client updates
+the segment after each blitted frame, the readers (arvid_stat) only map
+it read-only.
+
+The segment is protected by a sequence lock:
+Client:
+ - increments seq (odd value: update in progress)
+ - writes the values
+ - increments seq (even value: values are consistent)
+Reader:
+ - reads seq, waits while it is odd
+ - copies the values
+ - retries when seq changed meanwhile
+*/
+
+#define ARVID_METRICS_NAME "/arvid_metrics."
+#define ARVID_METRICS_MAGIC 0x4D445641
+#define ARVID_METRICS_VERSION 1
+#define ARVID_METRICS_CORES 8
+
+typedef struct arvid_metrics_t {
+	unsigned int magic;					//ARVID_METRICS_MAGIC
+	unsigned int version;				//ARVID_METRICS_VERSION
+	unsigned int size;					//size of this structure
+	unsigned int pid;					//process id of the client
+	volatile unsigned int seq;			//sequence lock
+	unsigned int cores;					//compression cores used
+	unsigned int width;					//size of the last blitted frame
+	unsigned int height;
+	unsigned long long time;			//time of the last update (usec, monotonic clock)
+	unsigned long long frames;			//blitted frames
+	unsigned long long droppedFrames;	//vsyncs missed by the blitted frames
+	unsigned long long bytesOut;
+	unsigned long long bytesIn;
+	unsigned long long packetsOut;
+	unsigned long long sendErrors;
+	unsigned long long rawBytes;		//frame data before compression
+	unsigned long long compressedBytes;	//frame data after compression
+	unsigned long long compressTime[ARVID_METRICS_CORES];	//per core (usec)
+	float fps;							//frames per second of the last second
+	float bytesPerSec;					//bytes sent per second of the last second
+	unsigned int blitTime;				//duration of the last blit (usec)
+	unsigned int vsyncRtt;				//last vsync request round trip (usec)
+	unsigned int commandRtt;			//smoothed command round trip (usec)
+	unsigned int reserved[5];
+} arvid_metrics;
+
+#endif
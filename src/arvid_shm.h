@@ -0,0 +1,69 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+#ifndef _ARVID_SHM_H_
+#define _ARVID_SHM_H_
+
+/*
+Shared-memory frame buffer exposed by the arvid-server to the clients
+running on the same host.
+
+The segment starts with the header followed by ARVID_SHM_BUFFERS frame
+buffers (bufferStride * bufferLines pixels each, RGB555).
+
+Client:
+ - writes the frame into the buffer not referenced by commitIndex
+ - stores the buffer index to commitIndex and increments commitSeq
+ - waits for the vsync on the vsyncSeq futex
+Server:
+ - at vsync copies the buffer referenced by commitIndex to its hidden
+   frame buffer when commitSeq changed
+ - updates frameNumber and buttons, increments vsyncSeq and wakes
+   up the waiting clients (FUTEX_WAKE on vsyncSeq)
+*/
+
+#define ARVID_SHM_NAME "/arvid_fb"
+#define ARVID_SHM_MAGIC 0x44495641
+#define ARVID_SHM_VERSION 1
+#define ARVID_SHM_BUFFERS 2
+
+typedef struct arvid_shm_header_t {
+	unsigned int magic;					//ARVID_SHM_MAGIC
+	unsigned int version;				//ARVID_SHM_VERSION
+	unsigned int size;					//size of the whole segment in bytes
+	unsigned int bufferOffset;			//offset of the first frame buffer in bytes
+	unsigned int bufferStride;			//pixels per line of the frame buffers
+	unsigned int bufferLines;			//lines of the frame buffers
+	volatile unsigned int width;		//width of the current video mode
+	volatile unsigned int height;		//height of the current video mode
+	volatile unsigned int commitIndex;	//frame buffer with the last committed frame
+	volatile unsigned int commitSeq;	//incremented by the client on each commit
+	volatile unsigned int vsyncSeq;		//incremented by the server on each vsync (futex)
+	volatile unsigned int frameNumber;	//frame number of the last vsync
+	volatile unsigned int buttons;		//button status of the last vsync
+	unsigned int reserved[3];
+} arvid_shm_header;
+
+#endif
@@ -0,0 +1,260 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+// Shows the live metrics of a running client (see arvid_metrics.h).
+// The metrics segment is mapped read-only, so the client is not
+// affected by the monitoring.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arvid_metrics.h"
+
+int pid = 0;
+int interval = 1000;
+char once = 0;
+char doPrintHelp = 0;
+
+static unsigned long long getTime(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int isRunning(int p) {
+	return kill(p, 0) == 0 || errno == EPERM;
+}
+
+// Removes the metrics segment left by a client that did not close
+// the connection (ie. crashed).
+static void removeStale(int p) {
+	char name[64];
+	sprintf(name, ARVID_METRICS_NAME "%i", p);
+	shm_unlink(name);
+}
+
+// Finds the metrics segment of a running client. Returns its pid
+// or 0 when there is none or there are several of them.
+static int findClient(void) {
+	DIR* dir = opendir("/dev/shm");
+	struct dirent* entry;
+	int prefixLen = strlen(ARVID_METRICS_NAME) - 1;
+	int found = 0;
+	int count = 0;
+
+	if (dir == NULL) {
+		return 0;
+	}
+	while ((entry = readdir(dir)) != NULL) {
+		int p;
+		if (strncmp(entry->d_name, ARVID_METRICS_NAME + 1, prefixLen) != 0) {
+			continue;
+		}
+		p = atoi(entry->d_name + prefixLen);
+		if (p <= 0) {
+			continue;
+		}
+		if (!isRunning(p)) {
+			removeStale(p);
+			continue;
+		}
+		if (count == 0) {
+			printf("running clients:");
+		}
+		printf(" %i", p);
+		found = p;
+		count++;
+	}
+	closedir(dir);
+	if (count > 1) {
+		printf("\nspecify the pid of the client\n");
+		return 0;
+	}
+	if (count == 1) {
+		printf("\n");
+	}
+	return found;
+}
+
+// Copies a consistent snapshot of the metrics.
+static int readMetrics(volatile arvid_metrics* m, arvid_metrics* snapshot) {
+	int i;
+	for (i = 0; i < 1000; i++) {
+		unsigned int seq = m->seq;
+		if (seq & 1) {
+			usleep(10);
+			continue;
+		}
+		__sync_synchronize();
+		memcpy(snapshot, (void*) m, sizeof(arvid_metrics));
+		__sync_synchronize();
+		if (m->seq == seq) {
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void printMetrics(arvid_metrics* m, arvid_metrics* prev, unsigned long long now) {
+	unsigned long long age = now > m->time ? now - m->time : 0;
+	unsigned long long period = m->time - prev->time;
+	unsigned long long frames = m->frames - prev->frames;
+	unsigned int cores = m->cores < ARVID_METRICS_CORES ? m->cores : ARVID_METRICS_CORES;
+	unsigned int i;
+
+	printf("arvid_stat - pid %u  %ux%u  cores %u  %s\n", m->pid, m->width, m->height,
+		m->cores, age > 2000000 ? "(idle)" : "");
+	printf("fps       %8.2f   frames %llu  dropped %llu\n", m->fps, m->frames, m->droppedFrames);
+	printf("out       %8.1f KB/s  total %llu KB  packets %llu  errors %llu\n", m->bytesPerSec / 1024,
+		m->bytesOut >> 10, m->packetsOut, m->sendErrors);
+	printf("in        %8llu KB\n", m->bytesIn >> 10);
+	printf("ratio     %8.2f\n", m->compressedBytes > 0 ? (float) m->rawBytes / m->compressedBytes : 0.0f);
+	printf("rtt       %8.2f ms vsync  %.2f ms command\n", m->vsyncRtt / 1000.0f, m->commandRtt / 1000.0f);
+	printf("blit      %8.2f ms\n", m->blitTime / 1000.0f);
+	printf("core    ");
+	for (i = 0; i < cores; i++) {
+		printf(" %7u", i);
+	}
+	//busy part of the update period and compression time per frame
+	printf("\nbusy %%  ");
+	for (i = 0; i < cores; i++) {
+		printf(" %7.1f", period > 0 ? (m->compressTime[i] - prev->compressTime[i]) * 100.0f / period : 0.0f);
+	}
+	printf("\nms/frame");
+	for (i = 0; i < cores; i++) {
+		printf(" %7.2f", frames > 0 ? (m->compressTime[i] - prev->compressTime[i]) / 1000.0f / frames : 0.0f);
+	}
+	printf("\n");
+}
+
+static void checkParams(int argc, char** argv) {
+	int i;
+	for (i = 1; i < argc; i++) {
+		char* arg = argv[i];
+		if (strcmp(arg, "-interval") == 0 && i + 1 < argc) {
+			interval = atoi(argv[++i]);
+		} else
+		if (strcmp(arg, "-once") == 0) {
+			once = 1;
+		} else
+		if (arg[0] != '-' && pid == 0) {
+			pid = atoi(arg);
+		} else {
+			doPrintHelp = 1;
+		}
+	}
+	if (interval < 10) {
+		doPrintHelp = 1;
+	}
+}
+
+static void printHelp(void) {
+	printf("Arvid client live metrics.\n");
+	printf("usage: arvid_stat [pid] [-interval ms] [-once]\n");
+	printf("  pid       : process id of the client (default the only running client)\n");
+	printf("  -interval : refresh interval in milliseconds (default 1000)\n");
+	printf("  -once     : print the metrics of a single interval and exit\n");
+}
+
+int main(int argc, char** argv) {
+	char name[64];
+	int fd;
+	volatile arvid_metrics* m;
+	arvid_metrics current;
+	arvid_metrics prev;
+
+	checkParams(argc, argv);
+	if (doPrintHelp) {
+		printHelp();
+		return -1;
+	}
+	if (pid == 0) {
+		pid = findClient();
+		if (pid == 0) {
+			printf("no client found\n");
+			return 1;
+		}
+	}
+
+	if (!isRunning(pid)) {
+		printf("client %i is not running\n", pid);
+		removeStale(pid);
+		return 1;
+	}
+	sprintf(name, ARVID_METRICS_NAME "%i", pid);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		printf("no metrics of the client %i\n", pid);
+		return 1;
+	}
+	m = (arvid_metrics*) mmap(NULL, sizeof(arvid_metrics), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED) {
+		printf("failed to map %s\n", name);
+		return 1;
+	}
+	if (m->magic != ARVID_METRICS_MAGIC || m->version != ARVID_METRICS_VERSION ||
+		m->size != sizeof(arvid_metrics)) {
+		printf("invalid metrics of the client %i\n", pid);
+		return 1;
+	}
+	if (readMetrics(m, &prev) != 0) {
+		printf("metrics of the client %i are not readable\n", pid);
+		return 1;
+	}
+
+	while (1) {
+		usleep(interval * 1000);
+		if (!isRunning(pid)) {
+			printf("client %i is not running\n", pid);
+			removeStale(pid);
+			break;
+		}
+		if (readMetrics(m, &current) != 0) {
+			continue;
+		}
+		if (!once) {
+			//clear the screen
+			printf("\033[H\033[2J");
+		}
+		printMetrics(&current, &prev, getTime());
+		fflush(stdout);
+		if (once) {
+			break;
+		}
+		prev = current;
+	}
+	munmap((void*) m, sizeof(arvid_metrics));
+	return 0;
+}
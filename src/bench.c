@@ -0,0 +1,449 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+// End-to-end blit benchmark. Drives the blit path with synthetic content
+// against a server (ie. the arvid_emu emulator) and sweeps the video modes,
+// blit types and core counts. For each run it reports frames per second,
+// blit and frame time percentiles, bytes per frame and CPU time per frame.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "arvid_client.h"
+
+#define MAX_W 640
+#define MAX_H 320
+#define MAX_FRAMES 10000
+#define MODE_COUNT 13
+#define GEN_COUNT 6
+#define MAX_CORES 8
+
+#define GEN_STATIC 0
+#define GEN_SPRITE 1
+#define GEN_SCROLL 2
+#define GEN_NOISE 3
+#define GEN_GRADIENT 4
+#define GEN_TEXT 5
+
+static const char* genName[GEN_COUNT] = {
+	"static", "sprite", "scroll", "noise", "gradient", "text"
+};
+
+static const int modeWidth[MODE_COUNT] = {
+	320, 256, 288, 384, 240, 392, 400, 292, 336, 416, 448, 512, 640
+};
+
+unsigned short fb[MAX_W * MAX_H];
+unsigned int blitTime[MAX_FRAMES];
+unsigned int frameTime[MAX_FRAMES];
+
+char* serverAddr = "127.0.0.1";
+int frames = 120;
+char useModes[MODE_COUNT];
+char useGens[GEN_COUNT];
+char useCores[MAX_CORES + 1];
+char useBlit[2];
+char waitVsync = 1;
+char csv = 0;
+char* traceFile = NULL;
+char doPrintHelp = 0;
+
+unsigned int randomSeed = 1;
+int posX, posY;
+int incX, incY;
+
+static unsigned long long getTime(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Returns the user + system CPU time of the process (all threads).
+static unsigned long long getCpuTime(void) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (unsigned long long) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+		usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static unsigned int getRandom(void) {
+	unsigned int x = randomSeed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	randomSeed = x;
+	return x;
+}
+
+static void fillRect(int w, int x, int y, int rw, int rh, unsigned short color) {
+	int j, i;
+	unsigned short* pix = fb + (y * w) + x;
+	for (j = 0; j < rh; j ++) {
+		for (i = 0; i < rw; i++) {
+			pix[i] = color;
+		}
+		pix += w;
+	}
+}
+
+// Checker board with stripes, every pixel changes when it moves.
+static void genScroll(int w, int h, int frame) {
+	int x, y;
+	unsigned short* pix = fb;
+	for (y = 0; y < h; y++) {
+		int sy = y + frame;
+		for (x = 0; x < w; x++) {
+			int sx = x + frame * 2;
+			pix[x] = (((sx >> 3) ^ (sy >> 3)) & 1) ? 0x7C00 | (sy & 0x1F) : 0x03E0 | (sx & 0x1F);
+		}
+		pix += w;
+	}
+}
+
+static void genNoise(int w, int h) {
+	int i;
+	for (i = 0; i < w * h; i++) {
+		fb[i] = getRandom() & 0x7FFF;
+	}
+}
+
+static void genGradient(int w, int h, int frame) {
+	int x, y;
+	unsigned short* pix = fb;
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			int r = (x * 31 / w + frame) & 0x1F;
+			int g = (y * 31 / h) & 0x1F;
+			int b = ((x + y) * 31 / (w + h) + (frame >> 1)) & 0x1F;
+			pix[x] = (r << 10) | (g << 5) | b;
+		}
+		pix += w;
+	}
+}
+
+// Text console: 8x8 pseudo glyphs scrolled by a line every 8 frames,
+// a few characters change each frame.
+static void genText(int w, int h, int frame) {
+	int x, y;
+	int scroll = frame >> 3;
+	unsigned short* pix = fb;
+	for (y = 0; y < h; y++) {
+		int row = (y >> 3) + scroll;
+		for (x = 0; x < w; x++) {
+			int col = x >> 3;
+			unsigned int c = (row * 131 + col * 31) % 96;
+			unsigned int bits;
+			//the last line is being typed
+			if (y >= h - 8 && col > frame % (w >> 3)) {
+				c = 0;
+			}
+			bits = c == 0 ? 0 : ((c * 2654435761u) >> ((y & 7) * 3)) & 0x7E;
+			pix[x] = (bits & (0x80 >> (x & 7))) ? 0x6318 : 0x0010;
+		}
+		pix += w;
+	}
+}
+
+static void genFrame(int gen, int w, int h, int frame) {
+	switch (gen) {
+		case GEN_STATIC:
+			if (frame == 0) {
+				genGradient(w, h, 0);
+			}
+			break;
+		case GEN_SPRITE:
+			if (frame == 0) {
+				posX = 100;
+				posY = 100;
+				incX = 2;
+				incY = 2;
+			}
+			posX += incX;
+			if (posX < 0 || posX > w - 32) {
+				incX = -incX;
+				posX += incX * 2;
+			}
+			posY += incY;
+			if (posY < 0 || posY > h - 32) {
+				incY = -incY;
+				posY += incY * 2;
+			}
+			fillRect(w, 0, 0, w, h, 0x432);
+			fillRect(w, posX, posY, 32, 32, 0xFFF);
+			break;
+		case GEN_SCROLL:
+			genScroll(w, h, frame);
+			break;
+		case GEN_NOISE:
+			genNoise(w, h);
+			break;
+		case GEN_GRADIENT:
+			genGradient(w, h, frame);
+			break;
+		case GEN_TEXT:
+			genText(w, h, frame);
+			break;
+	}
+}
+
+static int compareInt(const void* a, const void* b) {
+	unsigned int x = *(const unsigned int*) a;
+	unsigned int y = *(const unsigned int*) b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static unsigned int getPercentile(unsigned int* values, int count, int percent) {
+	int index = (count * percent) / 100;
+	if (index >= count) {
+		index = count - 1;
+	}
+	return values[index];
+}
+
+static void runBench(int gen, int mode, int blitType, int cores, int w, int h) {
+	unsigned long long startTime;
+	unsigned long long startCpu;
+	unsigned long long endTime;
+	unsigned long long endCpu;
+	unsigned long long totalBytes;
+	unsigned long long last;
+	int i;
+
+	//fill the frame with the content so the first blit is not special
+	genFrame(gen, w, h, 0);
+	arvid_client_blit_buffer(fb, w, h, w);
+	arvid_client_wait_for_vsync();
+	arvid_client_get_stat_transferred_size();
+
+	startCpu = getCpuTime();
+	startTime = getTime();
+	last = startTime;
+	for (i = 0; i < frames; i++) {
+		unsigned long long t;
+		genFrame(gen, w, h, i + 1);
+		t = getTime();
+		arvid_client_blit_buffer(fb, w, h, w);
+		blitTime[i] = (unsigned int) (getTime() - t);
+		if (waitVsync || blitType == ARVID_BLIT_TYPE_NON_BLOCKING) {
+			arvid_client_wait_for_vsync();
+		}
+		t = getTime();
+		frameTime[i] = (unsigned int) (t - last);
+		last = t;
+	}
+	endTime = getTime();
+	endCpu = getCpuTime();
+	totalBytes = arvid_client_get_stat_transferred_size();
+
+	qsort(blitTime, frames, sizeof(unsigned int), compareInt);
+	qsort(frameTime, frames, sizeof(unsigned int), compareInt);
+
+	if (csv) {
+		printf("%s,%i,%i,%s,%i,%.2f,%u,%u,%u,%u,%llu,%llu\n",
+			genName[gen], w, h, blitType ? "nonblocking" : "blocking", cores,
+			frames * 1000000.0 / (endTime - startTime),
+			getPercentile(blitTime, frames, 50), getPercentile(blitTime, frames, 99),
+			getPercentile(frameTime, frames, 50), getPercentile(frameTime, frames, 99),
+			totalBytes / frames, (endCpu - startCpu) / frames);
+	} else {
+		printf("%-8s %3ix%-3i %-11s %5i %7.2f %8u %8u %8u %8u %9.1f %9.2f\n",
+			genName[gen], w, h, blitType ? "nonblocking" : "blocking", cores,
+			frames * 1000000.0 / (endTime - startTime),
+			getPercentile(blitTime, frames, 50), getPercentile(blitTime, frames, 99),
+			getPercentile(frameTime, frames, 50), getPercentile(frameTime, frames, 99),
+			totalBytes / 1024.0 / frames, (endCpu - startCpu) / 1000.0 / frames);
+	}
+	fflush(stdout);
+}
+
+static void runCores(int cores) {
+	int mode, blitType, gen;
+
+	arvid_client_set_cpu_cores(cores);
+	if (arvid_client_connect(serverAddr) < 0) {
+		printf("failed to connect to %s\n", serverAddr);
+		return;
+	}
+	if (traceFile != NULL) {
+		arvid_client_set_trace(1);
+	}
+	for (mode = 0; mode < MODE_COUNT; mode++) {
+		int lines;
+		int w, h;
+		if (!useModes[mode]) {
+			continue;
+		}
+		lines = arvid_client_get_video_mode_lines(mode, 60.0f);
+		if (lines <= 0 || arvid_client_set_video_mode(mode, lines) != 0) {
+			printf("failed to set video mode %i\n", mode);
+			continue;
+		}
+		w = arvid_client_get_width();
+		h = arvid_client_get_height();
+		if (w <= 0 || w > MAX_W || h <= 0) {
+			printf("invalid video mode size %ix%i\n", w, h);
+			continue;
+		}
+		if (h > MAX_H) {
+			h = MAX_H;
+		}
+		for (blitType = 0; blitType < 2; blitType++) {
+			if (!useBlit[blitType] || arvid_client_set_blit_type(blitType) != 0) {
+				continue;
+			}
+			for (gen = 0; gen < GEN_COUNT; gen++) {
+				if (useGens[gen]) {
+					runBench(gen, mode, blitType, cores, w, h);
+				}
+			}
+		}
+	}
+	arvid_client_close();
+}
+
+// Parses comma separated list of names or numbers ('all' selects all).
+static int parseList(char* arg, char* use, int count, const char** names, const int* values) {
+	char buf[256];
+	char* item;
+	int i;
+
+	memset(use, 0, count);
+	strncpy(buf, arg, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	for (item = strtok(buf, ","); item != NULL; item = strtok(NULL, ",")) {
+		int found = 0;
+		for (i = 0; i < count; i++) {
+			if (strcmp(item, "all") == 0 ||
+				(names != NULL && strcmp(item, names[i]) == 0) ||
+				(values != NULL && atoi(item) == values[i])) {
+				use[i] = 1;
+				found = 1;
+			}
+		}
+		if (!found) {
+			printf("unknown item '%s'\n", item);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void checkParams(int argc, char** argv) {
+	static const int coreValues[MAX_CORES + 1] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+	static const char* blitNames[2] = {"blocking", "nonblocking"};
+	int i;
+	for (i = 1; i < argc; i++) {
+		char* arg = argv[i];
+		int result = 0;
+		if (strcmp(arg, "-addr") == 0 && i + 1 < argc) {
+			serverAddr = argv[++i];
+		} else
+		if (strcmp(arg, "-frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+			if (frames < 1 || frames > MAX_FRAMES) {
+				result = -1;
+			}
+		} else
+		if (strcmp(arg, "-modes") == 0 && i + 1 < argc) {
+			result = parseList(argv[++i], useModes, MODE_COUNT, NULL, modeWidth);
+		} else
+		if (strcmp(arg, "-gen") == 0 && i + 1 < argc) {
+			result = parseList(argv[++i], useGens, GEN_COUNT, genName, NULL);
+		} else
+		if (strcmp(arg, "-cores") == 0 && i + 1 < argc) {
+			result = parseList(argv[++i], useCores, MAX_CORES + 1, NULL, coreValues);
+			useCores[0] = 0;
+		} else
+		if (strcmp(arg, "-blit") == 0 && i + 1 < argc) {
+			result = parseList(argv[++i], useBlit, 2, blitNames, NULL);
+		} else
+		if (strcmp(arg, "-novsync") == 0) {
+			waitVsync = 0;
+		} else
+		if (strcmp(arg, "-csv") == 0) {
+			csv = 1;
+		} else
+		if (strcmp(arg, "-trace") == 0 && i + 1 < argc) {
+			traceFile = argv[++i];
+		} else {
+			result = -1;
+		}
+		if (result != 0) {
+			doPrintHelp = 1;
+		}
+	}
+}
+
+static void printHelp(void) {
+	printf("Arvid blit benchmark.\n");
+	printf("usage: bench [options]\n");
+	printf("  -addr ip          : server address (default 127.0.0.1)\n");
+	printf("  -frames n         : frames per run (default 120)\n");
+	printf("  -modes list       : video mode widths, ie. 320,640 or all (default 320,384,512,640)\n");
+	printf("  -gen list         : static,sprite,scroll,noise,gradient,text or all (default all)\n");
+	printf("  -cores list       : compression cores, ie. 1,2,4 or all (default 1,2,4)\n");
+	printf("  -blit list        : blocking,nonblocking or all (default all)\n");
+	printf("  -novsync          : do not wait for vsync in the blocking mode\n");
+	printf("  -csv              : print comma separated values\n");
+	printf("  -trace file       : write the timeline of the last frames as Chrome trace JSON\n");
+	printf("times are in microseconds, CPU time in milliseconds per frame\n");
+}
+
+int main(int argc, char** argv) {
+	int cores;
+
+	parseList("320,384,512,640", useModes, MODE_COUNT, NULL, modeWidth);
+	parseList("all", useGens, GEN_COUNT, genName, NULL);
+	memset(useCores, 0, sizeof(useCores));
+	useCores[1] = useCores[2] = useCores[4] = 1;
+	useBlit[0] = useBlit[1] = 1;
+
+	checkParams(argc, argv);
+	if (doPrintHelp) {
+		printHelp();
+		return -1;
+	}
+
+	if (csv) {
+		printf("gen,width,height,blit,cores,fps,blit_p50,blit_p99,frame_p50,frame_p99,bytes_frame,cpu_us_frame\n");
+	} else {
+		printf("%-8s %-7s %-11s %5s %7s %8s %8s %8s %8s %9s %9s\n", "gen", "mode", "blit",
+			"cores", "fps", "blit_p50", "blit_p99", "frm_p50", "frm_p99", "KB/frame", "cpu_ms");
+	}
+	for (cores = 1; cores <= MAX_CORES; cores++) {
+		if (useCores[cores]) {
+			runCores(cores);
+		}
+	}
+	if (traceFile != NULL) {
+		printf("trace events written: %i\n", arvid_client_dump_trace(traceFile));
+	}
+	return 0;
+}
@@ -0,0 +1,488 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+#include <stdlib.h>
+
+#include "arvid_client.h"
+#include "pixconv.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXCONV_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXCONV_NEON
+#endif
+
+//XRGB8888 (0xXXRRGGBB) to RGB555
+#define XRGB_TO_555(p) ((((p) >> 9) & 0x7C00) | (((p) >> 6) & 0x03E0) | (((p) >> 3) & 0x001F))
+//XBGR8888 (0xXXBBGGRR) to RGB555
+#define XBGR_TO_555(p) ((((p) << 7) & 0x7C00) | (((p) >> 6) & 0x03E0) | (((p) >> 19) & 0x001F))
+//RGB565 to RGB555 (the lowest green bit is dropped)
+#define RGB565_TO_555(p) ((((p) >> 1) & 0x7FE0) | ((p) & 0x001F))
+//BGR565 to RGB555
+#define BGR565_TO_555(p) ((((p) << 10) & 0x7C00) | (((p) >> 1) & 0x03E0) | ((p) >> 11))
+
+#if defined(PIXCONV_SSE2)
+// Converts 4 XRGB8888 (or XBGR8888 when 'bgr' is set) pixels to RGB555
+// values in 32 bit lanes.
+static inline __m128i convert8888Sse2_(__m128i p, int bgr) {
+	const __m128i maskR = _mm_set1_epi32(0x7C00);
+	const __m128i maskG = _mm_set1_epi32(0x03E0);
+	const __m128i maskB = _mm_set1_epi32(0x001F);
+	if (bgr) {
+		return _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(_mm_slli_epi32(p, 7), maskR),
+			_mm_and_si128(_mm_srli_epi32(p, 6), maskG)),
+			_mm_and_si128(_mm_srli_epi32(p, 19), maskB));
+	}
+	return _mm_or_si128(_mm_or_si128(
+		_mm_and_si128(_mm_srli_epi32(p, 9), maskR),
+		_mm_and_si128(_mm_srli_epi32(p, 6), maskG)),
+		_mm_and_si128(_mm_srli_epi32(p, 3), maskB));
+}
+#elif defined(PIXCONV_NEON)
+static inline uint16x4_t convert8888Neon_(uint32x4_t p, int bgr) {
+	const uint32x4_t maskR = vdupq_n_u32(0x7C00);
+	const uint32x4_t maskG = vdupq_n_u32(0x03E0);
+	const uint32x4_t maskB = vdupq_n_u32(0x001F);
+	if (bgr) {
+		p = vorrq_u32(vorrq_u32(
+			vandq_u32(vshlq_n_u32(p, 7), maskR),
+			vandq_u32(vshrq_n_u32(p, 6), maskG)),
+			vandq_u32(vshrq_n_u32(p, 19), maskB));
+	} else {
+		p = vorrq_u32(vorrq_u32(
+			vandq_u32(vshrq_n_u32(p, 9), maskR),
+			vandq_u32(vshrq_n_u32(p, 6), maskG)),
+			vandq_u32(vshrq_n_u32(p, 3), maskB));
+	}
+	return vmovn_u32(p);
+}
+#endif
+
+// Converts the 32 bit pixels. When 'bias' is not NULL the dither bias
+// of the pixel column (x % 4) is added to all the channels with
+// saturation before the lowest bits are cut off.
+static inline void convert8888_(unsigned short* dst, const unsigned int* s, int count,
+	const unsigned int* bias, int bgr) {
+	int i = 0;
+#if defined(PIXCONV_SSE2)
+	__m128i b = bias != NULL ? _mm_loadu_si128((const __m128i*) bias) : _mm_setzero_si128();
+	for (; i + 8 <= count; i += 8) {
+		__m128i p0 = _mm_loadu_si128((const __m128i*) (s + i));
+		__m128i p1 = _mm_loadu_si128((const __m128i*) (s + i + 4));
+		if (bias != NULL) {
+			p0 = _mm_adds_epu8(p0, b);
+			p1 = _mm_adds_epu8(p1, b);
+		}
+		//the values fit into 15 bits, so the signed saturation does no harm
+		_mm_storeu_si128((__m128i*) (dst + i),
+			_mm_packs_epi32(convert8888Sse2_(p0, bgr), convert8888Sse2_(p1, bgr)));
+	}
+#elif defined(PIXCONV_NEON)
+	uint8x16_t b = bias != NULL ? vreinterpretq_u8_u32(vld1q_u32(bias)) : vdupq_n_u8(0);
+	for (; i + 8 <= count; i += 8) {
+		uint32x4_t p0 = vld1q_u32(s + i);
+		uint32x4_t p1 = vld1q_u32(s + i + 4);
+		if (bias != NULL) {
+			p0 = vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(p0), b));
+			p1 = vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(p1), b));
+		}
+		vst1q_u16(dst + i, vcombine_u16(convert8888Neon_(p0, bgr), convert8888Neon_(p1, bgr)));
+	}
+#endif
+	for (; i < count; i++) {
+		unsigned int p = s[i];
+		if (bias != NULL) {
+			unsigned int d = bias[i & 3] & 0xFF;
+			unsigned int c0 = (p & 0xFF) + d;
+			unsigned int c1 = ((p >> 8) & 0xFF) + d;
+			unsigned int c2 = ((p >> 16) & 0xFF) + d;
+			p = (c0 > 0xFF ? 0xFF : c0) | ((c1 > 0xFF ? 0xFF : c1) << 8) |
+				((c2 > 0xFF ? 0xFF : c2) << 16);
+		}
+		dst[i] = (unsigned short) (bgr ? XBGR_TO_555(p) : XRGB_TO_555(p));
+	}
+}
+
+static void convertXrgb8888_(unsigned short* dst, const void* src, int count) {
+	convert8888_(dst, (const unsigned int*) src, count, NULL, 0);
+}
+
+static void convertXbgr8888_(unsigned short* dst, const void* src, int count) {
+	convert8888_(dst, (const unsigned int*) src, count, NULL, 1);
+}
+
+static void ditherXrgb8888_(unsigned short* dst, const void* src, int count, const unsigned int* bias) {
+	convert8888_(dst, (const unsigned int*) src, count, bias, 0);
+}
+
+static void ditherXbgr8888_(unsigned short* dst, const void* src, int count, const unsigned int* bias) {
+	convert8888_(dst, (const unsigned int*) src, count, bias, 1);
+}
+
+static void convertRgb565_(unsigned short* dst, const void* src, int count) {
+	const unsigned short* s = (const unsigned short*) src;
+	int i = 0;
+#if defined(PIXCONV_SSE2)
+	const __m128i maskRG = _mm_set1_epi16(0x7FE0);
+	const __m128i maskB = _mm_set1_epi16(0x001F);
+	for (; i + 8 <= count; i += 8) {
+		__m128i p = _mm_loadu_si128((const __m128i*) (s + i));
+		p = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 1), maskRG), _mm_and_si128(p, maskB));
+		_mm_storeu_si128((__m128i*) (dst + i), p);
+	}
+#elif defined(PIXCONV_NEON)
+	const uint16x8_t maskRG = vdupq_n_u16(0x7FE0);
+	const uint16x8_t maskB = vdupq_n_u16(0x001F);
+	for (; i + 8 <= count; i += 8) {
+		uint16x8_t p = vld1q_u16(s + i);
+		p = vorrq_u16(vandq_u16(vshrq_n_u16(p, 1), maskRG), vandq_u16(p, maskB));
+		vst1q_u16(dst + i, p);
+	}
+#endif
+	for (; i < count; i++) {
+		unsigned short p = s[i];
+		dst[i] = (unsigned short) RGB565_TO_555(p);
+	}
+}
+
+static void convertBgr565_(unsigned short* dst, const void* src, int count) {
+	const unsigned short* s = (const unsigned short*) src;
+	int i = 0;
+#if defined(PIXCONV_SSE2)
+	const __m128i maskR = _mm_set1_epi16(0x7C00);
+	const __m128i maskG = _mm_set1_epi16(0x03E0);
+	for (; i + 8 <= count; i += 8) {
+		__m128i p = _mm_loadu_si128((const __m128i*) (s + i));
+		p = _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(_mm_slli_epi16(p, 10), maskR),
+			_mm_and_si128(_mm_srli_epi16(p, 1), maskG)),
+			_mm_srli_epi16(p, 11));
+		_mm_storeu_si128((__m128i*) (dst + i), p);
+	}
+#elif defined(PIXCONV_NEON)
+	const uint16x8_t maskR = vdupq_n_u16(0x7C00);
+	const uint16x8_t maskG = vdupq_n_u16(0x03E0);
+	for (; i + 8 <= count; i += 8) {
+		uint16x8_t p = vld1q_u16(s + i);
+		p = vorrq_u16(vorrq_u16(
+			vandq_u16(vshlq_n_u16(p, 10), maskR),
+			vandq_u16(vshrq_n_u16(p, 1), maskG)),
+			vshrq_n_u16(p, 11));
+		vst1q_u16(dst + i, p);
+	}
+#endif
+	for (; i < count; i++) {
+		unsigned short p = s[i];
+		dst[i] = (unsigned short) BGR565_TO_555(p);
+	}
+}
+
+// Blends the RGB555 pixel a with b: a + (b - a) * w / 256 per channel.
+static inline unsigned short blend555_(unsigned int a, unsigned int b, int w) {
+	int r = (a >> 10) & 0x1F;
+	int g = (a >> 5) & 0x1F;
+	int c = a & 0x1F;
+	r += (((int) ((b >> 10) & 0x1F) - r) * w) >> 8;
+	g += (((int) ((b >> 5) & 0x1F) - g) * w) >> 8;
+	c += (((int) (b & 0x1F) - c) * w) >> 8;
+	return (unsigned short) ((r << 10) | (g << 5) | c);
+}
+
+#if defined(PIXCONV_SSE2)
+// Blends 8 RGB555 pixels, the weights are 0 - 256.
+static inline __m128i blend555Sse2_(__m128i a, __m128i b, __m128i w) {
+	const __m128i mask = _mm_set1_epi16(0x1F);
+	__m128i ar = _mm_and_si128(_mm_srli_epi16(a, 10), mask);
+	__m128i ag = _mm_and_si128(_mm_srli_epi16(a, 5), mask);
+	__m128i ab = _mm_and_si128(a, mask);
+	__m128i br = _mm_and_si128(_mm_srli_epi16(b, 10), mask);
+	__m128i bg = _mm_and_si128(_mm_srli_epi16(b, 5), mask);
+	__m128i bb = _mm_and_si128(b, mask);
+	//the difference times the weight fits into 16 bits
+	ar = _mm_add_epi16(ar, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(br, ar), w), 8));
+	ag = _mm_add_epi16(ag, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(bg, ag), w), 8));
+	ab = _mm_add_epi16(ab, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(bb, ab), w), 8));
+	return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(ar, 10), _mm_slli_epi16(ag, 5)), ab);
+}
+#elif defined(PIXCONV_NEON)
+static inline uint16x8_t blend555Neon_(uint16x8_t a, uint16x8_t b, int16x8_t w) {
+	const uint16x8_t mask = vdupq_n_u16(0x1F);
+	int16x8_t ar = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(a, 10), mask));
+	int16x8_t ag = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(a, 5), mask));
+	int16x8_t ab = vreinterpretq_s16_u16(vandq_u16(a, mask));
+	int16x8_t br = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(b, 10), mask));
+	int16x8_t bg = vreinterpretq_s16_u16(vandq_u16(vshrq_n_u16(b, 5), mask));
+	int16x8_t bb = vreinterpretq_s16_u16(vandq_u16(b, mask));
+	ar = vaddq_s16(ar, vshrq_n_s16(vmulq_s16(vsubq_s16(br, ar), w), 8));
+	ag = vaddq_s16(ag, vshrq_n_s16(vmulq_s16(vsubq_s16(bg, ag), w), 8));
+	ab = vaddq_s16(ab, vshrq_n_s16(vmulq_s16(vsubq_s16(bb, ab), w), 8));
+	return vorrq_u16(vorrq_u16(vshlq_n_u16(vreinterpretq_u16_s16(ar), 10),
+		vshlq_n_u16(vreinterpretq_u16_s16(ag), 5)), vreinterpretq_u16_s16(ab));
+}
+#endif
+
+// Blends 'count' pixels, the weight of each pixel is taken from 'weights'
+// or 'weight' is used for all of them when 'weights' is NULL.
+static void blendRows_(unsigned short* dst, const unsigned short* a, const unsigned short* b,
+	int count, const unsigned short* weights, int weight) {
+	int i = 0;
+#if defined(PIXCONV_SSE2)
+	__m128i w = _mm_set1_epi16(weight);
+	for (; i + 8 <= count; i += 8) {
+		if (weights != NULL) {
+			w = _mm_loadu_si128((const __m128i*) (weights + i));
+		}
+		_mm_storeu_si128((__m128i*) (dst + i), blend555Sse2_(
+			_mm_loadu_si128((const __m128i*) (a + i)),
+			_mm_loadu_si128((const __m128i*) (b + i)), w));
+	}
+#elif defined(PIXCONV_NEON)
+	int16x8_t w = vdupq_n_s16(weight);
+	for (; i + 8 <= count; i += 8) {
+		if (weights != NULL) {
+			w = vreinterpretq_s16_u16(vld1q_u16(weights + i));
+		}
+		vst1q_u16(dst + i, blend555Neon_(vld1q_u16(a + i), vld1q_u16(b + i), w));
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = blend555_(a[i], b[i], weights != NULL ? weights[i] : weight);
+	}
+}
+
+void pixconv_scale_row(unsigned short* dst, const unsigned short* src, int count,
+	const int* map, const unsigned short* weight) {
+	//pixels gathered from the source for the blend
+	unsigned short left[64];
+	unsigned short right[64];
+	int i, j;
+
+	if (weight == NULL) {
+		for (i = 0; i < count; i++) {
+			dst[i] = map[i] < 0 ? 0 : src[map[i]];
+		}
+		return;
+	}
+	for (i = 0; i < count; i += 64) {
+		int n = count - i < 64 ? count - i : 64;
+		for (j = 0; j < n; j++) {
+			int m = map[i + j];
+			left[j] = src[m];
+			//the last source column has zero weight of the next one
+			right[j] = weight[i + j] != 0 ? src[m + 1] : left[j];
+		}
+		blendRows_(dst + i, left, right, n, weight + i, 0);
+	}
+}
+
+void pixconv_blend_rows(unsigned short* dst, const unsigned short* a, const unsigned short* b,
+	int count, int weight) {
+	blendRows_(dst, a, b, count, NULL, weight);
+}
+
+#if defined(PIXCONV_SSE2)
+static inline void transpose8x8Sse2_(unsigned short* dst, int dstStride,
+	const unsigned short* src, int srcStride) {
+	__m128i r0 = _mm_loadu_si128((const __m128i*) (src));
+	__m128i r1 = _mm_loadu_si128((const __m128i*) (src + srcStride));
+	__m128i r2 = _mm_loadu_si128((const __m128i*) (src + 2 * srcStride));
+	__m128i r3 = _mm_loadu_si128((const __m128i*) (src + 3 * srcStride));
+	__m128i r4 = _mm_loadu_si128((const __m128i*) (src + 4 * srcStride));
+	__m128i r5 = _mm_loadu_si128((const __m128i*) (src + 5 * srcStride));
+	__m128i r6 = _mm_loadu_si128((const __m128i*) (src + 6 * srcStride));
+	__m128i r7 = _mm_loadu_si128((const __m128i*) (src + 7 * srcStride));
+	//pairs of rows interleaved
+	__m128i t0 = _mm_unpacklo_epi16(r0, r1);
+	__m128i t1 = _mm_unpackhi_epi16(r0, r1);
+	__m128i t2 = _mm_unpacklo_epi16(r2, r3);
+	__m128i t3 = _mm_unpackhi_epi16(r2, r3);
+	__m128i t4 = _mm_unpacklo_epi16(r4, r5);
+	__m128i t5 = _mm_unpackhi_epi16(r4, r5);
+	__m128i t6 = _mm_unpacklo_epi16(r6, r7);
+	__m128i t7 = _mm_unpackhi_epi16(r6, r7);
+	//columns of 4 rows
+	__m128i u0 = _mm_unpacklo_epi32(t0, t2);
+	__m128i u1 = _mm_unpackhi_epi32(t0, t2);
+	__m128i u2 = _mm_unpacklo_epi32(t1, t3);
+	__m128i u3 = _mm_unpackhi_epi32(t1, t3);
+	__m128i u4 = _mm_unpacklo_epi32(t4, t6);
+	__m128i u5 = _mm_unpackhi_epi32(t4, t6);
+	__m128i u6 = _mm_unpacklo_epi32(t5, t7);
+	__m128i u7 = _mm_unpackhi_epi32(t5, t7);
+	_mm_storeu_si128((__m128i*) (dst), _mm_unpacklo_epi64(u0, u4));
+	_mm_storeu_si128((__m128i*) (dst + dstStride), _mm_unpackhi_epi64(u0, u4));
+	_mm_storeu_si128((__m128i*) (dst + 2 * dstStride), _mm_unpacklo_epi64(u1, u5));
+	_mm_storeu_si128((__m128i*) (dst + 3 * dstStride), _mm_unpackhi_epi64(u1, u5));
+	_mm_storeu_si128((__m128i*) (dst + 4 * dstStride), _mm_unpacklo_epi64(u2, u6));
+	_mm_storeu_si128((__m128i*) (dst + 5 * dstStride), _mm_unpackhi_epi64(u2, u6));
+	_mm_storeu_si128((__m128i*) (dst + 6 * dstStride), _mm_unpacklo_epi64(u3, u7));
+	_mm_storeu_si128((__m128i*) (dst + 7 * dstStride), _mm_unpackhi_epi64(u3, u7));
+}
+#elif defined(PIXCONV_NEON)
+static inline void transpose8x8Neon_(unsigned short* dst, int dstStride,
+	const unsigned short* src, int srcStride) {
+	//pairs of rows interleaved
+	uint16x8x2_t a0 = vtrnq_u16(vld1q_u16(src), vld1q_u16(src + srcStride));
+	uint16x8x2_t a1 = vtrnq_u16(vld1q_u16(src + 2 * srcStride), vld1q_u16(src + 3 * srcStride));
+	uint16x8x2_t a2 = vtrnq_u16(vld1q_u16(src + 4 * srcStride), vld1q_u16(src + 5 * srcStride));
+	uint16x8x2_t a3 = vtrnq_u16(vld1q_u16(src + 6 * srcStride), vld1q_u16(src + 7 * srcStride));
+	//columns of 4 rows: b0 - columns 0, 4 and 2, 6; b1 - columns 1, 5 and 3, 7
+	uint32x4x2_t b0 = vtrnq_u32(vreinterpretq_u32_u16(a0.val[0]), vreinterpretq_u32_u16(a1.val[0]));
+	uint32x4x2_t b1 = vtrnq_u32(vreinterpretq_u32_u16(a0.val[1]), vreinterpretq_u32_u16(a1.val[1]));
+	uint32x4x2_t b2 = vtrnq_u32(vreinterpretq_u32_u16(a2.val[0]), vreinterpretq_u32_u16(a3.val[0]));
+	uint32x4x2_t b3 = vtrnq_u32(vreinterpretq_u32_u16(a2.val[1]), vreinterpretq_u32_u16(a3.val[1]));
+	vst1q_u16(dst, vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(b0.val[0]), vget_low_u32(b2.val[0]))));
+	vst1q_u16(dst + dstStride, vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(b1.val[0]), vget_low_u32(b3.val[0]))));
+	vst1q_u16(dst + 2 * dstStride, vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(b0.val[1]), vget_low_u32(b2.val[1]))));
+	vst1q_u16(dst + 3 * dstStride, vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(b1.val[1]), vget_low_u32(b3.val[1]))));
+	vst1q_u16(dst + 4 * dstStride, vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(b0.val[0]), vget_high_u32(b2.val[0]))));
+	vst1q_u16(dst + 5 * dstStride, vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(b1.val[0]), vget_high_u32(b3.val[0]))));
+	vst1q_u16(dst + 6 * dstStride, vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(b0.val[1]), vget_high_u32(b2.val[1]))));
+	vst1q_u16(dst + 7 * dstStride, vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(b1.val[1]), vget_high_u32(b3.val[1]))));
+}
+#endif
+
+void pixconv_transpose(unsigned short* dst, int dstStride, const unsigned short* src, int srcStride,
+	int width, int height) {
+	int x, y, i, j;
+
+	//8x8 tiles, the source rows of a tile are read once
+	for (x = 0; x + 8 <= width; x += 8) {
+		for (y = 0; y + 8 <= height; y += 8) {
+#if defined(PIXCONV_SSE2)
+			transpose8x8Sse2_(dst + x * dstStride + y, dstStride, src + y * srcStride + x, srcStride);
+#elif defined(PIXCONV_NEON)
+			transpose8x8Neon_(dst + x * dstStride + y, dstStride, src + y * srcStride + x, srcStride);
+#else
+			for (i = 0; i < 8; i++) {
+				for (j = 0; j < 8; j++) {
+					dst[(x + i) * dstStride + y + j] = src[(y + j) * srcStride + x + i];
+				}
+			}
+#endif
+		}
+		//the rest of the source rows
+		for (i = 0; i < 8; i++) {
+			for (j = y; j < height; j++) {
+				dst[(x + i) * dstStride + j] = src[j * srcStride + x + i];
+			}
+		}
+	}
+	//the rest of the source columns
+	for (i = x; i < width; i++) {
+		for (j = 0; j < height; j++) {
+			dst[i * dstStride + j] = src[j * srcStride + i];
+		}
+	}
+}
+
+void pixconv_reverse(unsigned short* dst, const unsigned short* src, int count) {
+	int i = 0;
+#if defined(PIXCONV_SSE2)
+	for (; i + 8 <= count; i += 8) {
+		__m128i p = _mm_loadu_si128((const __m128i*) (src + count - i - 8));
+		p = _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, 0x1B), 0x1B);
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_shuffle_epi32(p, 0x4E));
+	}
+#elif defined(PIXCONV_NEON)
+	for (; i + 8 <= count; i += 8) {
+		uint16x8_t p = vrev64q_u16(vld1q_u16(src + count - i - 8));
+		vst1q_u16(dst + i, vcombine_u16(vget_high_u16(p), vget_low_u16(p)));
+	}
+#endif
+	for (; i < count; i++) {
+		dst[i] = src[count - 1 - i];
+	}
+}
+
+void pixconv_lut(unsigned short* dst, const unsigned short* src, int count, const unsigned short* lut) {
+	int i = 0;
+	//there is no SIMD gather, unrolled to keep the loads in flight
+	for (; i + 4 <= count; i += 4) {
+		unsigned short p0 = lut[src[i] & 0x7FFF];
+		unsigned short p1 = lut[src[i + 1] & 0x7FFF];
+		unsigned short p2 = lut[src[i + 2] & 0x7FFF];
+		unsigned short p3 = lut[src[i + 3] & 0x7FFF];
+		dst[i] = p0;
+		dst[i + 1] = p1;
+		dst[i + 2] = p2;
+		dst[i + 3] = p3;
+	}
+	for (; i < count; i++) {
+		dst[i] = lut[src[i] & 0x7FFF];
+	}
+}
+
+pixconv_func pixconv_get(int format) {
+	switch (format) {
+		case ARVID_FORMAT_XRGB8888: return convertXrgb8888_;
+		case ARVID_FORMAT_XBGR8888: return convertXbgr8888_;
+		case ARVID_FORMAT_RGB565: return convertRgb565_;
+		case ARVID_FORMAT_BGR565: return convertBgr565_;
+	}
+	return NULL;
+}
+
+pixconv_dither_func pixconv_get_dither(int format) {
+	switch (format) {
+		case ARVID_FORMAT_XRGB8888: return ditherXrgb8888_;
+		case ARVID_FORMAT_XBGR8888: return ditherXbgr8888_;
+	}
+	return NULL;
+}
+
+void pixconv_dither_pattern(unsigned int pattern[4][4], int offset) {
+	//4x4 Bayer matrix
+	static const unsigned char bayer[4][4] = {
+		{ 0,  8,  2, 10},
+		{12,  4, 14,  6},
+		{ 3, 11,  1,  9},
+		{15,  7, 13,  5}
+	};
+	int x, y;
+	for (y = 0; y < 4; y++) {
+		for (x = 0; x < 4; x++) {
+			//the lowest 3 bits of each 8 bit channel are cut off
+			unsigned int d = bayer[(y + (offset >> 2)) & 3][(x + offset) & 3] >> 1;
+			pattern[y][x] = d | (d << 8) | (d << 16);
+		}
+	}
+}
+
+int pixconv_pixel_size(int format) {
+	switch (format) {
+		case ARVID_FORMAT_RGB555:
+		case ARVID_FORMAT_RGB565:
+		case ARVID_FORMAT_BGR565:
+			return 2;
+		case ARVID_FORMAT_XRGB8888:
+		case ARVID_FORMAT_XBGR8888:
+			return 4;
+	}
+	return 0;
+}
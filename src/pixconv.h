@@ -0,0 +1,93 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+#ifndef _PIXCONV_H_
+#define _PIXCONV_H_
+
+/*
+Pixel format conversion to the RGB555 format of the arvid frame buffer.
+The conversion runs per strip in the compression tasks, so the converted
+pixels are still in the cache when they are compressed. SSE2 and NEON
+kernels are used when the compiler targets them, scalar code otherwise.
+The 32 bit formats can be converted with the 4x4 ordered (Bayer) dither
+to avoid the banding of the gradients. The scaler works on RGB555 lines,
+so the source lines are converted first.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//converts 'count' pixels of the source format to RGB555
+typedef void (*pixconv_func)(unsigned short* dst, const void* src, int count);
+
+//returns the conversion function of the ARVID_FORMAT_xxx format,
+//NULL for RGB555 or an unknown format
+pixconv_func pixconv_get(int format);
+
+//converts 'count' pixels of a row to RGB555 with the ordered dither,
+//'bias' is the row of the dither pattern (see pixconv_dither_pattern)
+typedef void (*pixconv_dither_func)(unsigned short* dst, const void* src, int count,
+	const unsigned int* bias);
+
+//returns the dithering conversion function of the ARVID_FORMAT_xxx
+//format, NULL when the format is not dithered (16 bit formats)
+pixconv_dither_func pixconv_get_dither(int format);
+
+//fills the 4x4 ordered dither pattern shifted by 'offset' (0 - 15),
+//rows are indexed by y % 4 and columns by x % 4
+void pixconv_dither_pattern(unsigned int pattern[4][4], int offset);
+
+//scales a RGB555 line: dst[x] is src[map[x]] or, when 'weight' is not
+//NULL, src[map[x]] blended with src[map[x] + 1] by weight[x] / 256.
+//map[x] -1 gives a black pixel (only without the weight)
+void pixconv_scale_row(unsigned short* dst, const unsigned short* src, int count,
+	const int* map, const unsigned short* weight);
+
+//blends two RGB555 lines: dst = a + (b - a) * weight / 256
+void pixconv_blend_rows(unsigned short* dst, const unsigned short* a, const unsigned short* b,
+	int count, int weight);
+
+//transposes the block of 'width' x 'height' source pixels:
+//dst[x * dstStride + y] = src[y * srcStride + x]. The strides are in
+//pixels and can be negative to mirror the rows.
+void pixconv_transpose(unsigned short* dst, int dstStride, const unsigned short* src, int srcStride,
+	int width, int height);
+
+//copies the line in the reverse order (dst and src must not overlap)
+void pixconv_reverse(unsigned short* dst, const unsigned short* src, int count);
+
+//maps the RGB555 pixels through the 32K entry table: dst[x] = lut[src[x]]
+//(bit 15 of the source is ignored, dst can be the same as src)
+void pixconv_lut(unsigned short* dst, const unsigned short* src, int count, const unsigned short* lut);
+
+//returns bytes per pixel of the ARVID_FORMAT_xxx format, 0 when unknown
+int pixconv_pixel_size(int format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,213 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+// Replays the frames recorded by arvid_client_set_capture_file().
+// The capture file is memory mapped and the frames are blitted directly
+// from the mapping, either at the original pace or as fast as possible.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arvid_client.h"
+#include "arvid_capture.h"
+
+#define MODE_COUNT 13
+
+static const int modeWidth[MODE_COUNT] = {
+	320, 256, 288, 384, 240, 392, 400, 292, 336, 416, 448, 512, 640
+};
+
+char* serverAddr = "127.0.0.1";
+char* fileName = NULL;
+char maxRate = 0;
+char waitVsync = 0;
+int loops = 1;
+float refreshRate = 60.0f;
+char doPrintHelp = 0;
+
+static unsigned long long getTime(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleepUs(unsigned long long us) {
+	struct timespec ts;
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+}
+
+// Returns the video mode with the smallest width the frame fits into.
+static int findMode(int width) {
+	int mode = 12;
+	int i;
+	for (i = 0; i < MODE_COUNT; i++) {
+		if (modeWidth[i] >= width && modeWidth[i] < modeWidth[mode]) {
+			mode = i;
+		}
+	}
+	return mode;
+}
+
+static void checkParams(int argc, char** argv) {
+	int i;
+	for (i = 1; i < argc; i++) {
+		char* arg = argv[i];
+		if (strcmp(arg, "-addr") == 0 && i + 1 < argc) {
+			serverAddr = argv[++i];
+		} else
+		if (strcmp(arg, "-max") == 0) {
+			maxRate = 1;
+		} else
+		if (strcmp(arg, "-vsync") == 0) {
+			waitVsync = 1;
+		} else
+		if (strcmp(arg, "-loop") == 0 && i + 1 < argc) {
+			loops = atoi(argv[++i]);
+		} else
+		if (strcmp(arg, "-rate") == 0 && i + 1 < argc) {
+			refreshRate = atof(argv[++i]);
+		} else
+		if (arg[0] != '-' && fileName == NULL) {
+			fileName = arg;
+		} else {
+			doPrintHelp = 1;
+		}
+	}
+	if (fileName == NULL || loops < 1) {
+		doPrintHelp = 1;
+	}
+}
+
+static void printHelp(void) {
+	printf("Arvid capture replay tool.\n");
+	printf("usage: replay capture_file [-addr ip] [-max] [-vsync] [-loop n] [-rate hz]\n");
+	printf("  -addr  : server address (default 127.0.0.1)\n");
+	printf("  -max   : blit the frames as fast as possible (default original pace)\n");
+	printf("  -vsync : wait for vsync after each frame\n");
+	printf("  -loop  : number of replays\n");
+	printf("  -rate  : refresh rate of the video mode (default 60)\n");
+}
+
+int main(int argc, char** argv) {
+	int fd;
+	struct stat st;
+	unsigned char* data;
+	arvid_capture_header* header;
+	arvid_capture_frame* frame;
+	unsigned long long startTime;
+	unsigned long long blitTotal = 0;
+	unsigned long long bytesTotal = 0;
+	unsigned int frames = 0;
+	size_t offset;
+	int mode;
+	int loop;
+
+	checkParams(argc, argv);
+	if (doPrintHelp) {
+		printHelp();
+		return -1;
+	}
+
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		printf("failed to open %s\n", fileName);
+		return 1;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		printf("failed to map %s\n", fileName);
+		return 1;
+	}
+	header = (arvid_capture_header*) data;
+	if (st.st_size < sizeof(arvid_capture_header) + sizeof(arvid_capture_frame) ||
+		header->magic != ARVID_CAPTURE_MAGIC || header->version != ARVID_CAPTURE_VERSION ||
+		header->frameHeaderSize != sizeof(arvid_capture_frame) ||
+		header->headerSize < sizeof(arvid_capture_header) ||
+		(size_t) header->headerSize + sizeof(arvid_capture_frame) > (size_t) st.st_size) {
+		printf("invalid capture file %s\n", fileName);
+		return 1;
+	}
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	printf("connecting to %s ...\n", serverAddr);
+	if (arvid_client_connect(serverAddr) < 0) {
+		return 1;
+	}
+	frame = (arvid_capture_frame*) (data + header->headerSize);
+	mode = findMode(frame->width);
+	arvid_client_set_video_mode(mode, arvid_client_get_video_mode_lines(mode, refreshRate));
+	arvid_client_get_stat_transferred_size();
+
+	startTime = getTime();
+	for (loop = 0; loop < loops; loop++) {
+		unsigned long long loopTime = getTime();
+		offset = header->headerSize;
+		while (offset + sizeof(arvid_capture_frame) <= st.st_size) {
+			unsigned long long t;
+			frame = (arvid_capture_frame*) (data + offset);
+			offset += sizeof(arvid_capture_frame);
+			if (frame->size < frame->width * frame->height * 2 || offset + frame->size > st.st_size) {
+				printf("truncated frame %u\n", frame->index);
+				break;
+			}
+			//keep the original pace of the frames
+			if (!maxRate) {
+				t = getTime();
+				if (loopTime + frame->time > t) {
+					sleepUs(loopTime + frame->time - t);
+				}
+			}
+			t = getTime();
+			arvid_client_blit_buffer((unsigned short*) (data + offset), frame->width,
+				frame->height, frame->width);
+			blitTotal += getTime() - t;
+			if (waitVsync) {
+				arvid_client_wait_for_vsync();
+			}
+			offset += frame->size;
+			frames++;
+		}
+	}
+	if (frames > 0) {
+		unsigned long long time = getTime() - startTime;
+		bytesTotal = arvid_client_get_stat_transferred_size();
+		printf("frames=%u fps=%.2f blit=%.3f ms KB/frame=%.1f\n", frames,
+			frames * 1000000.0 / time, blitTotal / 1000.0 / frames,
+			bytesTotal / 1024.0 / frames);
+	}
+	arvid_client_close();
+	munmap(data, st.st_size);
+	return 0;
+}
@@ -0,0 +1,221 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tsync.h"
+#include "trace.h"
+
+//events per thread (power of 2)
+#define TRACE_RING_SIZE 16384
+#define TRACE_MAX_THREADS 32
+
+typedef struct trace_item_t {
+	unsigned long long time;
+	int arg;
+	unsigned char event;
+	char phase;
+} trace_item;
+
+typedef struct trace_ring_t {
+	volatile unsigned int head;		//number of recorded events
+	volatile unsigned int start;	//head at the start of the current recording
+	volatile unsigned int generation;	//recording the start belongs to
+	volatile int owned;				//ring is used by a running thread
+	char name[32];
+	trace_item item[TRACE_RING_SIZE];
+} trace_ring;
+
+static const char* eventName[TRACE_EVENT_COUNT] = {
+	"blit", "task", "deflate", "send", "wait_tasks", "vsync", "vsync_request", "resend", "pacing"
+};
+
+volatile int trace_enabled = 0;
+
+static trace_ring* rings[TRACE_MAX_THREADS];
+static volatile int ringCount = 0;
+static volatile unsigned int generation = 0;
+static unsigned long long startTime = 0;
+static __thread trace_ring* threadRing = NULL;
+static __thread const char* threadName = NULL;
+
+// Claims a ring released by an exited thread, the one with the same name first.
+static trace_ring* reuseRing_(const char* name) {
+	int i;
+	for (i = 0; i < ringCount && i < TRACE_MAX_THREADS; i++) {
+		trace_ring* ring = rings[i];
+		if (ring == NULL || ring->owned) {
+			continue;
+		}
+		if (name != NULL && strcmp(ring->name, name) != 0) {
+			continue;
+		}
+		if (__sync_bool_compare_and_swap(&ring->owned, 0, 1)) {
+			return ring;
+		}
+	}
+	return NULL;
+}
+
+// Returns the ring of the calling thread, creates it on the first use.
+static trace_ring* getRing_(void) {
+	int index;
+	trace_ring* ring;
+
+	if (threadRing != NULL) {
+		return threadRing;
+	}
+	ring = NULL;
+	if (threadName != NULL) {
+		ring = reuseRing_(threadName);
+	}
+	if (ring == NULL) {
+		ring = reuseRing_(NULL);
+	}
+	if (ring != NULL) {
+		if (threadName != NULL) {
+			strncpy(ring->name, threadName, sizeof(ring->name) - 1);
+		}
+		threadRing = ring;
+		return ring;
+	}
+	index = __sync_fetch_and_add(&ringCount, 1);
+	if (index >= TRACE_MAX_THREADS) {
+		__sync_fetch_and_sub(&ringCount, 1);
+		return NULL;
+	}
+	ring = (trace_ring*) calloc(1, sizeof(trace_ring));
+	if (ring == NULL) {
+		return NULL;
+	}
+	ring->owned = 1;
+	if (threadName != NULL) {
+		strncpy(ring->name, threadName, sizeof(ring->name) - 1);
+	} else {
+		sprintf(ring->name, "thread %i", index);
+	}
+	threadRing = ring;
+	//publish the ring after it is initialised
+	__sync_synchronize();
+	rings[index] = ring;
+	return ring;
+}
+
+void trace_event(int event, char phase, int arg) {
+	trace_ring* ring = getRing_();
+	trace_item* item;
+
+	if (ring == NULL) {
+		return;
+	}
+	//a new recording was started: only the owner moves its start marker
+	if (ring->generation != generation) {
+		ring->start = ring->head;
+		__sync_synchronize();
+		ring->generation = generation;
+	}
+	item = &ring->item[ring->head & (TRACE_RING_SIZE - 1)];
+	item->time = tsync_get_time_us();
+	item->arg = arg;
+	item->event = (unsigned char) event;
+	item->phase = phase;
+	//publish the event after it is written
+	__sync_synchronize();
+	ring->head++;
+}
+
+void trace_thread_name(const char* name) {
+	threadName = name;
+	if (threadRing != NULL) {
+		strncpy(threadRing->name, name, sizeof(threadRing->name) - 1);
+	}
+}
+
+void trace_thread_exit(void) {
+	if (threadRing != NULL) {
+		//the events must be written before the ring is handed over
+		__sync_synchronize();
+		threadRing->owned = 0;
+		threadRing = NULL;
+	}
+}
+
+void trace_enable(int enable) {
+	if (enable && !trace_enabled) {
+		//forget the events of the previous recording, the ring owners
+		//move their start markers on their next event
+		startTime = tsync_get_time_us();
+		__sync_synchronize();
+		generation++;
+	}
+	trace_enabled = enable;
+}
+
+int trace_dump(const char* fileName) {
+	FILE* f = fopen(fileName, "w");
+	int total = 0;
+	int i;
+
+	if (f == NULL) {
+		return -1;
+	}
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (i = 0; i < ringCount && i < TRACE_MAX_THREADS; i++) {
+		trace_ring* ring = rings[i];
+		unsigned int head;
+		unsigned int j;
+		if (ring == NULL) {
+			continue;
+		}
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+			total > 0 ? ",\n" : "", i, ring->name);
+		total++;
+		//the ring has no events of the current recording
+		if (ring->generation != generation) {
+			continue;
+		}
+		__sync_synchronize();
+		j = ring->start;
+		head = ring->head;
+		if (head - j > TRACE_RING_SIZE) {
+			j = head - TRACE_RING_SIZE;
+		}
+		for (; j != head; j++) {
+			trace_item* item = &ring->item[j & (TRACE_RING_SIZE - 1)];
+			if (item->event >= TRACE_EVENT_COUNT || item->time < startTime) {
+				continue;
+			}
+			fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":%i%s,\"args\":{\"v\":%i}}",
+				eventName[item->event], item->phase, item->time - startTime, i,
+				item->phase == 'i' ? ",\"s\":\"t\"" : "", item->arg);
+			total++;
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	return total;
+}
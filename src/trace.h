@@ -0,0 +1,78 @@
+/*
+Arvid software and hardware is licensed under MIT license:
+
+Copyright (c) 2015 - 2017 Marek Olejnik
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this hardware, software, and associated documentation files (the "Product"),
+to deal in the Product without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Product, and to permit persons to whom the Product is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Product.
+
+THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE PRODUCT OR THE USE OR OTHER DEALINGS
+IN THE PRODUCT.
+
+*/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+Timeline tracing. Each thread records the events into its own ring
+buffer (single writer, no locks), the oldest events are overwritten.
+The rings are exported as Chrome trace JSON (chrome://tracing, Perfetto).
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//traced events
+#define TRACE_BLIT 0			//blit_buffer call (arg: frame)
+#define TRACE_TASK 1			//compression task job (arg: task index)
+#define TRACE_DEFLATE 2			//compression of a strip (arg: strip)
+#define TRACE_SEND 3			//sending the packets (arg: bytes)
+#define TRACE_WAIT_TASKS 4		//waiting for the compression tasks
+#define TRACE_VSYNC 5			//wait_for_vsync call (arg: frame)
+#define TRACE_VSYNC_REQUEST 6	//vsync request to the server and its reply (arg: frame)
+#define TRACE_RESEND 7			//command resent (arg: command)
+#define TRACE_PACING 8			//transmit pacing delay (arg: usec)
+#define TRACE_EVENT_COUNT 9
+
+extern volatile int trace_enabled;
+
+//records the start, the end or an instant event of the calling thread
+void trace_event(int event, char phase, int arg);
+
+#define TRACE_BEGIN(event, arg) do { if (trace_enabled) trace_event(event, 'B', arg); } while (0)
+#define TRACE_END(event, arg) do { if (trace_enabled) trace_event(event, 'E', arg); } while (0)
+#define TRACE_INSTANT(event, arg) do { if (trace_enabled) trace_event(event, 'i', arg); } while (0)
+
+//names the calling thread in the trace
+void trace_thread_name(const char* name);
+
+//releases the ring of the calling thread before the thread ends,
+//the ring (and its events) is reused by the next new thread
+void trace_thread_exit(void);
+
+//enables or disables the recording
+void trace_enable(int enable);
+
+//writes the recorded events as Chrome trace JSON.
+//returns number of written events, negative on failure
+int trace_dump(const char* fileName);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif